@@ -0,0 +1,222 @@
+/*
+Copyright (c) 2014 Helios (helios.vmg@gmail.com)
+
+This software is provided 'as-is', in the hope that it will be useful, but
+without any express or implied warranty. In no event will the authors be held
+liable for any damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose, including
+commercial applications, and to alter it and redistribute it freely, subject to
+the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would
+       be appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not
+       be misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+       distribution.
+
+    4. The user is granted all rights over the textual output of this
+       software.
+
+*/
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+/*
+Reference decoders, written the way one would by hand for each of the specs
+in specs/: straight off a buffer, with one bounds check per run of fixed
+size data. The records have the same members as the generated types, so
+the benchmark can checksum both with the same code. Little-endian data are
+loaded with memcpy, which assumes a little-endian host.
+*/
+namespace baseline{
+
+inline uint16_t load_le16(const uint8_t *p){
+	uint16_t ret;
+	memcpy(&ret, p, sizeof(ret));
+	return ret;
+}
+
+inline uint32_t load_le32(const uint8_t *p){
+	uint32_t ret;
+	memcpy(&ret, p, sizeof(ret));
+	return ret;
+}
+
+inline uint64_t load_le64(const uint8_t *p){
+	uint64_t ret;
+	memcpy(&ret, p, sizeof(ret));
+	return ret;
+}
+
+inline uint16_t load_be16(const uint8_t *p){
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+inline uint32_t load_be32(const uint8_t *p){
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+inline uint64_t load_be64(const uint8_t *p){
+	return (uint64_t)load_be32(p) << 32 | load_be32(p + 4);
+}
+
+// Reads a NUL-terminated string and moves p past the terminator.
+inline bool load_cstring(std::string &dst, const uint8_t *&p, const uint8_t *end){
+	auto terminator = (const uint8_t *)memchr(p, 0, end - p);
+	if (!terminator)
+		return false;
+	dst.assign((const char *)p, terminator - p);
+	p = terminator + 1;
+	return true;
+}
+
+inline bool load_string(std::string &dst, const uint8_t *&p, const uint8_t *end, size_t length){
+	if ((size_t)(end - p) < length)
+		return false;
+	dst.assign((const char *)p, length);
+	p += length;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+struct Header{
+	uint64_t timestamp;
+	uint32_t magic;
+	int32_t x,
+		y;
+	uint16_t version,
+		flags;
+	int16_t z;
+	uint8_t kind,
+		priority;
+};
+
+inline bool decode(Header &r, const uint8_t *&p, const uint8_t *end){
+	if (end - p < 28)
+		return false;
+	r.magic = load_le32(p);
+	r.version = load_le16(p + 4);
+	r.flags = load_le16(p + 6);
+	r.timestamp = load_le64(p + 8);
+	r.x = (int32_t)load_le32(p + 16);
+	r.y = (int32_t)load_le32(p + 20);
+	r.z = (int16_t)load_le16(p + 24);
+	r.kind = p[26];
+	r.priority = p[27];
+	if (r.magic != 0x48424E58)
+		return false;
+	p += 28;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+struct Entry{
+	uint32_t id;
+	uint16_t length;
+	std::string key,
+		value,
+		code;
+};
+
+inline bool decode(Entry &r, const uint8_t *&p, const uint8_t *end){
+	if (end - p < 4)
+		return false;
+	r.id = load_le32(p);
+	p += 4;
+	if (!load_cstring(r.key, p, end) || end - p < 2)
+		return false;
+	r.length = load_le16(p);
+	p += 2;
+	return load_string(r.value, p, end, r.length) && load_string(r.code, p, end, 8);
+}
+
+//-----------------------------------------------------------------------------
+
+struct Quote{
+	int64_t price;
+	uint64_t sequence;
+	uint32_t instrument;
+	int32_t quantity;
+	uint16_t venue;
+	int16_t change;
+};
+
+inline bool decode(Quote &r, const uint8_t *&p, const uint8_t *end){
+	if (end - p < 28)
+		return false;
+	r.instrument = load_be32(p);
+	r.price = (int64_t)load_be64(p + 4);
+	r.quantity = (int32_t)load_be32(p + 12);
+	r.venue = load_be16(p + 16);
+	r.change = (int16_t)load_be16(p + 18);
+	r.sequence = load_be64(p + 20);
+	p += 28;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+struct Reading{
+	int32_t value;
+	uint16_t sensor;
+	uint8_t unit;
+	std::string label;
+};
+
+inline bool decode(Reading &r, const uint8_t *&p, const uint8_t *end){
+	if (end - p < 7)
+		return false;
+	r.sensor = load_le16(p);
+	r.value = (int32_t)load_le32(p + 2);
+	r.unit = p[6];
+	p += 7;
+	return load_cstring(r.label, p, end);
+}
+
+//-----------------------------------------------------------------------------
+
+struct Frame{
+	uint32_t id;
+	uint16_t count;
+	std::vector<int16_t> samples;
+	std::vector<uint8_t> digest;
+	std::vector<uint32_t> deltas;
+};
+
+inline bool decode(Frame &r, const uint8_t *&p, const uint8_t *end){
+	if (end - p < 6)
+		return false;
+	r.id = load_le32(p);
+	r.count = load_le16(p + 4);
+	p += 6;
+	if ((size_t)(end - p) < (size_t)r.count * 2 + 16)
+		return false;
+	r.samples.resize(r.count);
+	if (r.count)
+		memcpy(&r.samples[0], p, r.count * 2);
+	p += r.count * 2;
+	r.digest.assign(p, p + 16);
+	p += 16;
+	r.deltas.clear();
+	while (1){
+		if (end - p < 4)
+			return false;
+		auto delta = load_le32(p);
+		p += 4;
+		if (!delta)
+			return true;
+		r.deltas.push_back(delta);
+	}
+}
+
+} // namespace baseline
@@ -0,0 +1,409 @@
+/*
+Copyright (c) 2014 Helios (helios.vmg@gmail.com)
+
+This software is provided 'as-is', in the hope that it will be useful, but
+without any express or implied warranty. In no event will the authors be held
+liable for any damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose, including
+commercial applications, and to alter it and redistribute it freely, subject to
+the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would
+       be appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not
+       be misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+       distribution.
+
+    4. The user is granted all rights over the textual output of this
+       software.
+
+*/
+
+/*
+Measures the generated parsers against hand-written decoders (baselines.h).
+Every spec in specs/ is compiled by Xabin before this file is built (see the
+pre-build event in Benchmark.vcxproj), and the outputs are included below.
+For each spec, a synthetic corpus of random records is parsed in full with
+every runtime backend, repeatedly, until the time limit for that backend
+runs out. Every backend must come up with the same checksum of the records.
+The interpreter (interpreter.h) loads the same specs at runtime, from the
+given directory.
+
+Usage: Benchmark [corpus size in MiB] [seconds per backend] [spec directory]
+*/
+#include "stdafx.h"
+#include "parser.h"
+#include "library.h"
+#include "interpreter.h"
+#include "baselines.h"
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <boost/format.hpp>
+
+#include "flat.inc"
+#include "strings.inc"
+#include "bigendian.inc"
+#include "nested.inc"
+#include "arrays.inc"
+
+// Every allocation made by the process is counted.
+static uint64_t allocations = 0;
+
+void *operator new(size_t n){
+	allocations++;
+	if (auto ret = malloc(n ? n : 1))
+		return ret;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept{
+	free(p);
+}
+
+// Lets an std::istream read a buffer in place.
+class BufferStreamBuf : public std::streambuf{
+public:
+	BufferStreamBuf(const std::string &buffer){
+		auto p = (char *)buffer.data();
+		this->setg(p, p, p + buffer.size());
+	}
+};
+
+typedef std::mt19937 Random;
+
+static std::string random_text(Random &random, size_t min_length, size_t max_length){
+	std::string ret(std::uniform_int_distribution<size_t>(min_length, max_length)(random), 0);
+	for (auto &c : ret)
+		c = 'a' + random() % 26;
+	return ret;
+}
+
+//-----------------------------------------------------------------------------
+
+/*
+A spec names the generated type and the baseline record it's compared with,
+fills in random records for the corpus, and reduces a record of either kind
+to a checksum. GenericRecords, from the interpreter, keep each kind of datum
+in the order of the spec.
+*/
+struct FlatSpec{
+	typedef flat::Header Record;
+	typedef baseline::Header Baseline;
+	static const char *name(){
+		return "flat";
+	}
+	static void generate(Record &r, Random &random){
+		r.magic = 0x48424E58;
+		r.version = random() % 4;
+		r.flags = (uint16_t)random();
+		r.timestamp = (uint64_t)random() << 32 | random();
+		r.x = (int32_t)random();
+		r.y = (int32_t)random();
+		r.z = (int16_t)random();
+		r.kind = (uint8_t)random();
+		r.priority = (uint8_t)random();
+	}
+	template <typename T>
+	static uint64_t checksum(const T &r){
+		return r.magic + r.version + r.flags + r.timestamp + r.x + r.y + r.z + r.kind + r.priority;
+	}
+	static uint64_t checksum(const GenericRecord &r){
+		uint64_t ret = 0;
+		for (auto x : r.integers)
+			ret += x;
+		return ret;
+	}
+};
+
+struct StringsSpec{
+	typedef strings::Entry Record;
+	typedef baseline::Entry Baseline;
+	static const char *name(){
+		return "strings";
+	}
+	static void generate(Record &r, Random &random){
+		r.id = random();
+		r.key = random_text(random, 4, 24);
+		r.value = random_text(random, 0, 200);
+		r.length = (uint16_t)r.value.size();
+		r.code = random_text(random, 8, 8);
+	}
+	template <typename T>
+	static uint64_t checksum(const T &r){
+		return r.id + r.key.size() + r.length + r.value.size() + (uint8_t)r.code[0];
+	}
+	static uint64_t checksum(const GenericRecord &r){
+		return r.integers[0] + r.strings[0].size() + r.integers[1] + r.strings[1].size() + (uint8_t)r.strings[2][0];
+	}
+};
+
+struct BigEndianSpec{
+	typedef bigendian::Quote Record;
+	typedef baseline::Quote Baseline;
+	static const char *name(){
+		return "bigendian";
+	}
+	static void generate(Record &r, Random &random){
+		r.instrument = random();
+		r.price = (int64_t)((uint64_t)random() << 32 | random());
+		r.quantity = (int32_t)random();
+		r.venue = (uint16_t)random();
+		r.change = (int16_t)random();
+		r.sequence = (uint64_t)random() << 32 | random();
+	}
+	template <typename T>
+	static uint64_t checksum(const T &r){
+		return r.instrument + r.price + r.quantity + r.venue + r.change + r.sequence;
+	}
+	static uint64_t checksum(const GenericRecord &r){
+		uint64_t ret = 0;
+		for (auto x : r.integers)
+			ret += x;
+		return ret;
+	}
+};
+
+struct NestedSpec{
+	typedef nested::telemetry::Reading Record;
+	typedef baseline::Reading Baseline;
+	static const char *name(){
+		return "nested";
+	}
+	static void generate(Record &r, Random &random){
+		r.sensor = (uint16_t)random();
+		r.value = (int32_t)random();
+		r.unit = (uint8_t)random();
+		r.label = random_text(random, 0, 32);
+	}
+	template <typename T>
+	static uint64_t checksum(const T &r){
+		return r.sensor + r.value + r.unit + r.label.size();
+	}
+	static uint64_t checksum(const GenericRecord &r){
+		// Summed as the members would be, int overflow included.
+		return (uint16_t)r.integers[0] + (int32_t)r.integers[1] + (uint8_t)r.integers[2] + r.strings[0].size();
+	}
+};
+
+struct ArraysSpec{
+	typedef arrays::Frame Record;
+	typedef baseline::Frame Baseline;
+	static const char *name(){
+		return "arrays";
+	}
+	static void generate(Record &r, Random &random){
+		r.id = random();
+		r.count = random() % 64;
+		r.samples.resize(r.count);
+		for (auto &sample : r.samples)
+			sample = (int16_t)random();
+		r.digest.resize(16);
+		for (auto &byte : r.digest)
+			byte = (uint8_t)random();
+		// The deltas are terminated by a zero.
+		r.deltas.resize(random() % 16);
+		for (auto &delta : r.deltas)
+			delta = random() | 1;
+	}
+	template <typename T>
+	static uint64_t checksum(const T &r){
+		uint64_t ret = r.id + r.count + r.digest[15] + r.deltas.size();
+		for (auto sample : r.samples)
+			ret += sample;
+		return ret;
+	}
+	static uint64_t checksum(const GenericRecord &r){
+		uint64_t ret = r.integers[0] + r.integers[1] + r.arrays[1][15] + r.arrays[2].size();
+		for (auto sample : r.arrays[0])
+			ret += sample;
+		return ret;
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+struct Corpus{
+	std::string data;
+	size_t records;
+};
+
+template <typename Spec>
+Corpus generate_corpus(size_t size){
+	Corpus ret;
+	ret.records = 0;
+	Random random(1);
+	typename Spec::Record record;
+	std::vector<uint8_t> buffer;
+	while (ret.data.size() < size){
+		Spec::generate(record, random);
+		buffer.resize(record.encoded_size());
+		record.serialize(buffer.data());
+		ret.data.append((const char *)buffer.data(), buffer.size());
+		ret.records++;
+	}
+	return ret;
+}
+
+struct Measurement{
+	unsigned passes;
+	double seconds;
+	uint64_t allocations;
+	uint64_t checksum;
+};
+
+// Runs pass over the whole corpus until at least the given time has elapsed.
+// pass returns the checksum of the records it parsed.
+template <typename F>
+Measurement measure(double seconds, F pass){
+	typedef std::chrono::steady_clock clock;
+	Measurement ret;
+	ret.passes = 0;
+	ret.checksum = 0;
+	auto allocations_before = allocations;
+	auto start = clock::now();
+	std::chrono::duration<double> elapsed;
+	do{
+		ret.checksum = pass();
+		ret.passes++;
+		elapsed = clock::now() - start;
+	}while (elapsed.count() < seconds);
+	ret.seconds = elapsed.count();
+	ret.allocations = allocations - allocations_before;
+	return ret;
+}
+
+/*
+Benchmarks every backend on the corpus of one spec. Returns false if any of
+them disagrees with the baseline.
+*/
+template <typename Spec>
+bool run(size_t corpus_size, double seconds, const std::string &spec_directory){
+	typedef typename Spec::Record Record;
+	auto corpus = generate_corpus<Spec>(corpus_size);
+	const char *path = "benchmark.tmp";
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write(corpus.data.data(), corpus.data.size());
+	}
+	std::vector<std::pair<const char *, Measurement> > results;
+	results.push_back(std::make_pair("baseline", measure(seconds, [&](){
+		uint64_t checksum = 0;
+		typename Spec::Baseline record;
+		auto p = (const uint8_t *)corpus.data.data(),
+			end = p + corpus.data.size();
+		for (size_t i = 0; i < corpus.records; i++){
+			if (!baseline::decode(record, p, end))
+				return (uint64_t)0;
+			checksum += Spec::checksum(record);
+		}
+		return checksum;
+	})));
+	results.push_back(std::make_pair("MemorySource", measure(seconds, [&](){
+		uint64_t checksum = 0;
+		MemorySource source(corpus.data.data(), corpus.data.size());
+		for (size_t i = 0; i < corpus.records; i++)
+			checksum += Spec::checksum(Record(source));
+		return checksum;
+	})));
+	// Reads every record over the same instance, which should stop
+	// allocating once its strings and arrays are large enough.
+	results.push_back(std::make_pair("MemorySource reused", measure(seconds, [&](){
+		uint64_t checksum = 0;
+		MemorySource source(corpus.data.data(), corpus.data.size());
+		Record record;
+		for (size_t i = 0; i < corpus.records; i++){
+			Record::parse_into(record, source);
+			checksum += Spec::checksum(record);
+		}
+		return checksum;
+	})));
+	Parser parser;
+	std::vector<BytecodeProgram> programs;
+	auto spec_path = spec_directory + Spec::name() + ".xml";
+	if (parser.load_xml(spec_path.c_str()) == Parser::MetaParserStatus::SUCCESS && parser.compile_bytecode(programs) == Parser::MetaParserStatus::SUCCESS){
+		auto &program = programs.front();
+		results.push_back(std::make_pair("interpreter", measure(seconds, [&](){
+			uint64_t checksum = 0;
+			GenericRecord record;
+			auto p = (const uint8_t *)corpus.data.data(),
+				end = p + corpus.data.size();
+			for (size_t i = 0; i < corpus.records; i++){
+				if (program.run(record, p, end) != ParserStatus::SUCCESS)
+					return (uint64_t)0;
+				checksum += Spec::checksum(record);
+			}
+			return checksum;
+		})));
+	}else
+		std::cerr <<"Couldn't load "<<spec_path<<", skipping the interpreter.\n";
+	results.push_back(std::make_pair("MappedFileSource", measure(seconds, [&](){
+		uint64_t checksum = 0;
+		MappedFileSource source(path);
+		for (size_t i = 0; i < corpus.records; i++)
+			checksum += Spec::checksum(Record(source));
+		return checksum;
+	})));
+	results.push_back(std::make_pair("BufferedStreamSource", measure(seconds, [&](){
+		uint64_t checksum = 0;
+		BufferStreamBuf buffer(corpus.data);
+		std::istream stream(&buffer);
+		BufferedStreamSource source(stream);
+		for (size_t i = 0; i < corpus.records; i++)
+			checksum += Spec::checksum(Record(source));
+		return checksum;
+	})));
+	results.push_back(std::make_pair("std::istream", measure(seconds, [&](){
+		uint64_t checksum = 0;
+		BufferStreamBuf buffer(corpus.data);
+		std::istream stream(&buffer);
+		for (size_t i = 0; i < corpus.records; i++)
+			checksum += Spec::checksum(Record(stream));
+		return checksum;
+	})));
+	remove(path);
+
+	bool ret = 1;
+	auto expected = results.front().second.checksum;
+	for (auto &result : results){
+		auto &m = result.second;
+		double bytes = (double)corpus.data.size() * m.passes,
+			records = (double)corpus.records * m.passes;
+		std::cout <<boost::format("%-10s %-21s %10.1f MB/s %12.0f records/s %8.2f allocs/record%s\n")
+			% Spec::name()
+			% result.first
+			% (bytes / m.seconds / 1e6)
+			% (records / m.seconds)
+			% (m.allocations / records)
+			% (m.checksum == expected ? "" : "  CHECKSUM MISMATCH");
+		if (m.checksum != expected)
+			ret = 0;
+	}
+	return ret;
+}
+
+int main(int argc, char **argv){
+	size_t corpus_size = (size_t)((argc > 1 ? atof(argv[1]) : 16) * (1 << 20));
+	double seconds = argc > 2 ? atof(argv[2]) : 1;
+	std::string spec_directory = argc > 3 ? argv[3] : "specs/";
+	bool ok = 1;
+	ok &= run<FlatSpec>(corpus_size, seconds, spec_directory);
+	ok &= run<StringsSpec>(corpus_size, seconds, spec_directory);
+	ok &= run<BigEndianSpec>(corpus_size, seconds, spec_directory);
+	ok &= run<NestedSpec>(corpus_size, seconds, spec_directory);
+	ok &= run<ArraysSpec>(corpus_size, seconds, spec_directory);
+	return ok ? 0 : 1;
+}
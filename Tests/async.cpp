@@ -0,0 +1,192 @@
+/*
+Copyright (c) 2014 Helios (helios.vmg@gmail.com)
+
+This software is provided 'as-is', in the hope that it will be useful, but
+without any express or implied warranty. In no event will the authors be held
+liable for any damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose, including
+commercial applications, and to alter it and redistribute it freely, subject to
+the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would
+       be appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not
+       be misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+       distribution.
+
+    4. The user is granted all rights over the textual output of this
+       software.
+
+*/
+
+/*
+Parses records from many socketpairs at once with AsyncFdSource and
+AsyncReactor. A writer thread feeds every socket the same stream of records
+in small random chunks, so that the parsers are suspended at arbitrary
+points of the records, and each socket ends with a truncated record.
+Requires a POSIX host and C++20, with specs/async.xml compiled by Xabin:
+
+    Xabin specs/async.xml > async.inc
+    c++ -std=c++20 -DBIN_USE_EXCEPTIONS -I../Xabin -I. async.cpp ../Xabin/library.cpp -pthread
+
+Usage: async [sockets] [records per socket]
+*/
+
+#include "library.h"
+#include <iostream>
+#include <cstdlib>
+#include <random>
+#include <sys/socket.h>
+#include <fcntl.h>
+
+#include "async.inc"
+
+#if !defined(BIN_HAS_COROUTINES) || defined(_WIN32)
+#error This test requires coroutines and a POSIX host.
+#endif
+
+static void append_integer(std::string &dst, uint64_t value, unsigned size, bool big_endian){
+	for (unsigned i = 0; i < size; i++){
+		auto shift = (big_endian ? size - 1 - i : i) * 8;
+		dst.push_back((char)(value >> shift));
+	}
+}
+
+static std::string expected_name(int i){
+	return "message" + std::to_string(i);
+}
+
+static std::string generate_stream(int records){
+	std::string ret;
+	for (int i = 0; i < records; i++){
+		append_integer(ret, 0x4D424E58, 4, false);
+		append_integer(ret, (uint16_t)-i, 2, false);
+		ret += expected_name(i);
+		ret.push_back(0);
+		append_integer(ret, i * 3, 4, false);
+		for (int j = 0; j < i * 3; j++)
+			ret.push_back('a' + j % 26);
+		for (int j = 0; j < i * 3; j++)
+			append_integer(ret, (uint16_t)(j - 100), 2, false);
+		for (int j = 0; j < i % 4; j++)
+			append_integer(ret, (uint32_t)-(j + 1), 4, true);
+		append_integer(ret, 0, 4, true);
+		ret += "TAG!";
+	}
+	// A record that never ends.
+	append_integer(ret, 0x4D424E58, 4, false);
+	append_integer(ret, 0, 2, false);
+	return ret;
+}
+
+static bool check(const async::Message &message, int i){
+	if (message.delta != -i || message.name != expected_name(i) || message.length != (uint32_t)i * 3 || message.tag != "TAG!")
+		return 0;
+	if (message.payload.size() != message.length || message.samples.size() != message.length || message.terminated.size() != (size_t)i % 4)
+		return 0;
+	for (size_t j = 0; j < message.samples.size(); j++)
+		if (message.payload[j] != (char)('a' + j % 26) || message.samples[j] != (int)j - 100)
+			return 0;
+	for (size_t j = 0; j < message.terminated.size(); j++)
+		if (message.terminated[j] != -(int)(j + 1))
+			return 0;
+	return 1;
+}
+
+// Drives a consumer eagerly, without a result.
+struct Consumer{
+	struct promise_type{
+		Consumer get_return_object(){
+			return Consumer();
+		}
+		std::suspend_never initial_suspend() noexcept{
+			return std::suspend_never();
+		}
+		std::suspend_never final_suspend() noexcept{
+			return std::suspend_never();
+		}
+		void return_void(){}
+		void unhandled_exception(){
+			std::terminate();
+		}
+	};
+};
+
+static int passed = 0;
+static int failed = 0;
+
+static Consumer consume(AsyncFdSource &source, int records){
+	for (int i = 0; i < records; i++){
+		async::Message message;
+		auto status = co_await message.parse_async(source);
+		if (status != ParserStatus::SUCCESS || !check(message, i)){
+			failed++;
+			co_return;
+		}
+	}
+	async::Message message;
+	if (co_await message.parse_async(source) != ParserStatus::UNEXPECTED_EOF){
+		failed++;
+		co_return;
+	}
+	passed++;
+}
+
+int main(int argc, char **argv){
+	int sockets = argc > 1 ? atoi(argv[1]) : 300;
+	int records = argc > 2 ? atoi(argv[2]) : 30;
+	auto stream = generate_stream(records);
+
+	std::vector<int> readers(sockets),
+		writers(sockets);
+	for (int i = 0; i < sockets; i++){
+		int pair[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)){
+			std::cerr << "socketpair() failed.\n";
+			return 1;
+		}
+		fcntl(pair[0], F_SETFL, fcntl(pair[0], F_GETFL) | O_NONBLOCK);
+		readers[i] = pair[0];
+		writers[i] = pair[1];
+	}
+
+	AsyncReactor reactor;
+	std::vector<std::unique_ptr<AsyncFdSource> > sources;
+	for (int i = 0; i < sockets; i++){
+		// Small buffers make the parsers wait in the middle of most data.
+		sources.emplace_back(new AsyncFdSource(reactor, readers[i], 64));
+		consume(*sources.back(), records);
+	}
+
+	std::thread writer([&](){
+		std::mt19937 random(1);
+		std::vector<size_t> written(sockets);
+		int open = sockets;
+		while (open){
+			int i = random() % sockets;
+			if (written[i] == stream.size())
+				continue;
+			size_t n = std::min<size_t>(stream.size() - written[i], random() % 50 + 1);
+			auto result = write(writers[i], stream.data() + written[i], n);
+			if (result > 0)
+				written[i] += result;
+			if (written[i] == stream.size()){
+				close(writers[i]);
+				open--;
+			}
+		}
+	});
+	reactor.run();
+	writer.join();
+	for (auto fd : readers)
+		close(fd);
+
+	std::cout << passed << " of " << sockets << " sockets parsed correctly.\n";
+	return passed == sockets && !failed ? 0 : 1;
+}
@@ -0,0 +1,454 @@
+/*
+Copyright (c) 2014 Helios (helios.vmg@gmail.com)
+
+This software is provided 'as-is', in the hope that it will be useful, but
+without any express or implied warranty. In no event will the authors be held
+liable for any damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose, including
+commercial applications, and to alter it and redistribute it freely, subject to
+the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would
+       be appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not
+       be misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+       distribution.
+
+    4. The user is granted all rights over the textual output of this
+       software.
+
+*/
+#include "stdafx.h"
+#include "parser.h"
+#include <cstdio>
+#include <atomic>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+/*
+The cache holds the types of a spec as they were resolved from the XML, so
+that loading them takes no XML parsing. Everything is little endian, at a
+fixed offset from the start of the file, so it can be read in place from a
+mapped file:
+
+	header, 32 bytes:
+		"XABINSPC"
+		u32 version
+		u32 type count
+		u64 hash of the XML, see Parser::hash_spec()
+		u32 datum count
+		u32 size of the string table
+	types, 16 bytes each:
+		u32 name
+		u32 namespaces, joined with "::"
+		u32 first datum
+		u32 datum count
+	data, 20 bytes each:
+		u8 DataType
+		u8 integer type id, of the integer or the array's elements
+		u8 Endianness
+		u8 NegativeMapping
+		u8 cached_*_flag
+		u8 CachedLength
+		u8 Requirement::Relation, NONE if there's no requirement
+		u8 zero
+		u32 name
+		u32 length, the value or the name of the datum it's read from
+		u32 value of the requirement
+	string table:
+		u32 size, followed by the characters of each string
+
+Strings are referred to by their offset into the table.
+*/
+
+static const char cache_magic[] = "XABINSPC";
+// Must change whenever the layout, or the meaning of anything in it, does.
+static const uint32_t cache_version = 1;
+static const size_t cache_header_size = 32,
+	cache_type_size = 16,
+	cache_datum_size = 20;
+
+enum class CachedLength{
+	NONE,
+	FIXED,
+	CSTYLE,
+	PRESTATED,
+	USER,
+};
+
+const uint8_t cached_borrowed_flag = 1 << 0;
+const uint8_t cached_pmr_flag = 1 << 1;
+
+uint64_t Parser::hash_spec(const void *data, size_t size){
+	// FNV-1a.
+	uint64_t ret = 0xCBF29CE484222325ULL;
+	auto p = (const uint8_t *)data;
+	for (size_t i = 0; i < size; i++){
+		ret ^= p[i];
+		ret *= 0x100000001B3ULL;
+	}
+	return ret;
+}
+
+//-----------------------------------------------------------------------------
+
+class CacheWriter{
+	std::string strings;
+	std::map<std::string, uint32_t> string_offsets;
+public:
+	std::string data;
+	void put(uint8_t x){
+		this->data.push_back((char)x);
+	}
+	void put(uint32_t x){
+		for (int i = 0; i < 4; i++)
+			this->put((uint8_t)(x >> 8 * i));
+	}
+	void put(uint64_t x){
+		for (int i = 0; i < 8; i++)
+			this->put((uint8_t)(x >> 8 * i));
+	}
+	void put_string(const std::string &s){
+		auto it = this->string_offsets.find(s);
+		if (it != this->string_offsets.end()){
+			this->put(it->second);
+			return;
+		}
+		auto offset = (uint32_t)this->strings.size();
+		this->string_offsets[s] = offset;
+		for (int i = 0; i < 4; i++)
+			this->strings.push_back((char)((uint32_t)s.size() >> 8 * i));
+		this->strings.append(s);
+		this->put(offset);
+	}
+	const std::string &get_strings() const{
+		return this->strings;
+	}
+};
+
+static std::string join_namespaces(const std::vector<std::string> &namespaces){
+	std::string ret;
+	for (auto &ns : namespaces){
+		if (ret.size())
+			ret.append("::");
+		ret.append(ns);
+	}
+	return ret;
+}
+
+static void write_length(CacheWriter &writer, const ArrayLength *length, std::string &value){
+	CachedLength kind = CachedLength::NONE;
+	if (length){
+		if (length->is_fixed()){
+			kind = CachedLength::FIXED;
+			value = ((const FixedArrayLength *)length)->length;
+		}else if (!strcmp(length->get_length_word(), "cstyle"))
+			kind = CachedLength::CSTYLE;
+		else{
+			kind = !strcmp(length->get_length_word(), "user_length") ? CachedLength::USER : CachedLength::PRESTATED;
+			value = *length->get_dependency();
+		}
+	}
+	writer.put((uint8_t)kind);
+}
+
+static void write_datum(CacheWriter &writer, const DefinedDatum &datum){
+	const DefinedInteger *integer = nullptr;
+	switch (datum.get_type()){
+		case DataType::INTEGER:
+			integer = (const DefinedInteger *)&datum;
+			break;
+		case DataType::STRING:
+			break;
+		case DataType::ARRAY:
+			integer = ((const DefinedArray &)datum).get_element_type();
+			break;
+		default:
+			throw Parser::MetaParserStatus::DATUM_NOT_PROPERLY_DEFINED;
+	}
+	writer.put((uint8_t)datum.get_type());
+	writer.put((uint8_t)(integer ? integer->get_int_type_id() : 0));
+	writer.put((uint8_t)(integer ? integer->get_endianness() : Endianness::LITTLE));
+	writer.put((uint8_t)(integer ? integer->get_negative_mapping() : NegativeMapping::TWOSCOMP));
+	uint8_t flags = 0;
+	if (datum.is_borrowed())
+		flags |= cached_borrowed_flag;
+	if (datum.uses_allocator())
+		flags |= cached_pmr_flag;
+	writer.put(flags);
+	std::string length;
+	write_length(writer, datum.get_length(), length);
+	auto req = datum.get_requirement();
+	writer.put((uint8_t)(req ? req->get_relation() : Requirement::Relation::NONE));
+	writer.put((uint8_t)0);
+	writer.put_string(datum.get_name());
+	writer.put_string(length);
+	writer.put_string(req ? req->get_value() : std::string());
+}
+
+Parser::MetaParserStatus Parser::save_cache(const char *path, uint64_t content_hash) const{
+	CacheWriter writer;
+	uint32_t datum_count = 0;
+	for (auto &type : this->types)
+		datum_count += (uint32_t)type->get_data().size();
+	writer.data.append(cache_magic, 8);
+	writer.put(cache_version);
+	writer.put((uint32_t)this->types.size());
+	writer.put(content_hash);
+	writer.put(datum_count);
+	// The size of the string table goes here, once it's known.
+	writer.put((uint32_t)0);
+	uint32_t first_datum = 0;
+	for (auto &type : this->types){
+		writer.put_string(type->get_name());
+		writer.put_string(join_namespaces(type->get_namespaces()));
+		writer.put(first_datum);
+		writer.put((uint32_t)type->get_data().size());
+		first_datum += (uint32_t)type->get_data().size();
+	}
+	try{
+		for (auto &type : this->types)
+			for (auto &datum : type->get_data())
+				write_datum(writer, *datum);
+	}catch (const Parser::MetaParserStatus &status){
+		return status;
+	}
+	auto &strings = writer.get_strings();
+	for (int i = 0; i < 4; i++)
+		writer.data[cache_header_size - 4 + i] = (char)((uint32_t)strings.size() >> 8 * i);
+	writer.data.append(strings);
+
+	// The cache is written to a file of its own and renamed over the old
+	// one, so that processes writing it at the same time don't write into
+	// each other's file, and readers never see a partly written cache.
+	static std::atomic<unsigned> counter(0);
+	auto temporary = (boost::format("%1%.%2%.%3%.tmp") % path % getpid() % counter++).str();
+	{
+		std::ofstream file(temporary.c_str(), std::ios::binary);
+		if (!file.write(writer.data.data(), writer.data.size()) || !file.flush()){
+			file.close();
+			std::remove(temporary.c_str());
+			return MetaParserStatus::FILE_ERROR;
+		}
+	}
+	bool renamed = !std::rename(temporary.c_str(), path);
+#ifdef _WIN32
+	// Windows won't rename over an existing file. Another process may
+	// still recreate it in between, in which case its cache stands.
+	if (!renamed){
+		std::remove(path);
+		renamed = !std::rename(temporary.c_str(), path);
+	}
+#endif
+	if (!renamed){
+		std::remove(temporary.c_str());
+		return MetaParserStatus::FILE_ERROR;
+	}
+	return MetaParserStatus::SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+
+// Reads the cache in place. Throws FILE_ERROR if anything lies outside of it.
+class CacheReader{
+	const uint8_t *begin;
+	size_t size;
+	const uint8_t *strings;
+	size_t strings_size;
+public:
+	CacheReader(const void *data, size_t size): begin((const uint8_t *)data), size(size), strings(nullptr), strings_size(0){}
+	const uint8_t *at(size_t offset, size_t n) const{
+		if (offset > this->size || this->size - offset < n)
+			throw Parser::MetaParserStatus::FILE_ERROR;
+		return this->begin + offset;
+	}
+	uint8_t get_u8(size_t offset) const{
+		return *this->at(offset, 1);
+	}
+	uint32_t get_u32(size_t offset) const{
+		auto p = this->at(offset, 4);
+		uint32_t ret = 0;
+		for (int i = 4; i--;)
+			ret = (ret << 8) | p[i];
+		return ret;
+	}
+	uint64_t get_u64(size_t offset) const{
+		return this->get_u32(offset) | ((uint64_t)this->get_u32(offset + 4) << 32);
+	}
+	void set_strings(size_t offset, size_t size){
+		this->strings = this->at(offset, size);
+		this->strings_size = size;
+	}
+	std::string get_string(size_t offset) const{
+		auto string = this->get_u32(offset);
+		if (string > this->strings_size || this->strings_size - string < 4)
+			throw Parser::MetaParserStatus::FILE_ERROR;
+		auto p = this->strings + string;
+		uint32_t n = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+		if (this->strings_size - string - 4 < n)
+			throw Parser::MetaParserStatus::FILE_ERROR;
+		return std::string((const char *)p + 4, n);
+	}
+};
+
+static std::vector<std::string> split_namespaces(const std::string &s){
+	std::vector<std::string> ret;
+	for (size_t i = 0; i < s.size();){
+		auto next = s.find("::", i);
+		if (next == s.npos)
+			next = s.size();
+		ret.push_back(s.substr(i, next - i));
+		i = next + 2;
+	}
+	return ret;
+}
+
+static IntegerType read_integer_type(uint8_t id){
+	IntegerType ret = { !!(id & 1), (unsigned)(id >> 1) * 8 };
+	switch (ret.bitness){
+		case 8:
+		case 16:
+		case 32:
+		case 64:
+			return ret;
+	}
+	throw Parser::MetaParserStatus::FILE_ERROR;
+}
+
+static boost::shared_ptr<ArrayLength> read_length(CachedLength kind, const std::string &value){
+	boost::shared_ptr<ArrayLength> ret;
+	switch (kind){
+		case CachedLength::FIXED:
+			ret.reset(new FixedArrayLength(value));
+			break;
+		case CachedLength::CSTYLE:
+			ret.reset(new CStyleArrayLength);
+			break;
+		case CachedLength::PRESTATED:
+			ret.reset(new PrestatedArrayLength(value));
+			break;
+		case CachedLength::USER:
+			ret.reset(new UserArrayLength(value));
+			break;
+		default:
+			throw Parser::MetaParserStatus::FILE_ERROR;
+	}
+	return ret;
+}
+
+static boost::shared_ptr<DefinedDatum> read_datum(const CacheReader &reader, size_t offset){
+	auto type = (DataType)reader.get_u8(offset);
+	IntegerFormat format;
+	format.endianness = (Endianness)reader.get_u8(offset + 2);
+	format.negative_mapping = (NegativeMapping)reader.get_u8(offset + 3);
+	auto flags = reader.get_u8(offset + 4);
+	bool borrow = !!(flags & cached_borrowed_flag),
+		pmr = !!(flags & cached_pmr_flag);
+	auto length = (CachedLength)reader.get_u8(offset + 5);
+	auto relation = (Requirement::Relation)reader.get_u8(offset + 6);
+	// The generator asserts on values outside of the enums.
+	if (format.endianness > Endianness::BIG || format.negative_mapping > NegativeMapping::EXCESSKBIASED || relation > Requirement::Relation::GEQ)
+		throw Parser::MetaParserStatus::FILE_ERROR;
+	auto name = reader.get_string(offset + 8);
+	boost::shared_ptr<Requirement> req;
+	if (relation != Requirement::Relation::NONE)
+		req.reset(new Requirement(relation, reader.get_string(offset + 16)));
+	switch (type){
+		case DataType::INTEGER:
+			{
+				boost::shared_ptr<DefinedInteger> ret(new DefinedInteger(name, format, read_integer_type(reader.get_u8(offset + 1))));
+				ret->set_requirement(req);
+				return ret;
+			}
+		case DataType::STRING:
+			{
+				boost::shared_ptr<DefinedString> ret(new DefinedString(name, read_length(length, reader.get_string(offset + 12)), borrow, pmr));
+				ret->set_requirement(req);
+				return ret;
+			}
+		case DataType::ARRAY:
+			return boost::shared_ptr<DefinedDatum>(new DefinedArray(
+				name,
+				format,
+				read_integer_type(reader.get_u8(offset + 1)),
+				read_length(length, reader.get_string(offset + 12)),
+				borrow,
+				pmr
+			));
+		default:
+			break;
+	}
+	throw Parser::MetaParserStatus::FILE_ERROR;
+}
+
+Parser::MetaParserStatus Parser::load_cache(const void *data, size_t size, uint64_t content_hash){
+	CacheReader reader(data, size);
+	std::vector<boost::shared_ptr<DefinedType> > types;
+	try{
+		if (memcmp(reader.at(0, cache_header_size), cache_magic, 8))
+			return MetaParserStatus::FILE_ERROR;
+		if (reader.get_u32(8) != cache_version || reader.get_u64(16) != content_hash)
+			return MetaParserStatus::STALE_CACHE;
+		size_t type_count = reader.get_u32(12),
+			datum_count = reader.get_u32(24),
+			data_offset = cache_header_size + type_count * cache_type_size,
+			strings_offset = data_offset + datum_count * cache_datum_size;
+		reader.set_strings(strings_offset, reader.get_u32(28));
+		for (size_t i = 0; i < type_count; i++){
+			auto offset = cache_header_size + i * cache_type_size;
+			boost::shared_ptr<DefinedType> type(new DefinedType);
+			type->set_name(reader.get_string(offset));
+			type->set_namespace(split_namespaces(reader.get_string(offset + 4)));
+			size_t first = reader.get_u32(offset + 8),
+				count = reader.get_u32(offset + 12);
+			if (first > datum_count || datum_count - first < count)
+				return MetaParserStatus::FILE_ERROR;
+			for (size_t j = first; j < first + count; j++)
+				type->add_datum(read_datum(reader, data_offset + j * cache_datum_size));
+			types.push_back(type);
+		}
+	}catch (const Parser::MetaParserStatus &status){
+		return status;
+	}
+	this->types.insert(this->types.end(), types.begin(), types.end());
+	return MetaParserStatus::SUCCESS;
+}
+
+static bool read_file(const char *path, std::string &dst){
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return 0;
+	dst.resize((size_t)file.tellg());
+	file.seekg(0);
+	return !!file.read(&dst[0], dst.size());
+}
+
+Parser::MetaParserStatus Parser::load_cached(const char *xml_path, const char *cache_path){
+	std::string xml;
+	if (!read_file(xml_path, xml))
+		return MetaParserStatus::FILE_NOT_FOUND;
+	auto hash = hash_spec(xml.data(), xml.size());
+	std::string cache;
+	if (read_file(cache_path, cache) && this->load_cache(cache.data(), cache.size(), hash) == MetaParserStatus::SUCCESS)
+		return MetaParserStatus::SUCCESS;
+
+	tinyxml2::XMLDocument doc;
+	if (doc.Parse(xml.data(), xml.size()) != tinyxml2::XML_SUCCESS)
+		return MetaParserStatus::UNKNOWN_XML_ERROR;
+	auto ret = this->load_xml(doc);
+	if (ret != MetaParserStatus::SUCCESS)
+		return ret;
+	// A cache that can't be written only costs the next load some time.
+	this->save_cache(cache_path, hash);
+	return MetaParserStatus::SUCCESS;
+}
@@ -0,0 +1,602 @@
+/*
+Copyright (c) 2014 Helios (helios.vmg@gmail.com)
+
+This software is provided 'as-is', in the hope that it will be useful, but
+without any express or implied warranty. In no event will the authors be held
+liable for any damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose, including
+commercial applications, and to alter it and redistribute it freely, subject to
+the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would
+       be appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not
+       be misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+       distribution.
+
+    4. The user is granted all rights over the textual output of this
+       software.
+
+*/
+#include "stdafx.h"
+#include "parser.h"
+#include "library.h"
+#include "interpreter.h"
+#include <cerrno>
+#include <cstdlib>
+
+template <typename T, unsigned N, bool BigEndian, template <typename> class F>
+struct GenericDecoderOf{
+	static int64_t decode(const uint8_t *p){
+		return (int64_t)decode_integer<T, N, BigEndian, F>(p);
+	}
+	static void decode_array(int64_t *dst, const uint8_t *src, size_t count){
+		for (size_t i = 0; i < count; i++)
+			dst[i] = (int64_t)decode_integer<T, N, BigEndian, F>(src + i * N);
+	}
+	static GenericDecoder get(){
+		GenericDecoder ret = { N, decode, decode_array };
+		return ret;
+	}
+};
+
+template <typename T, unsigned N, bool BigEndian>
+static GenericDecoder select_decoder(NegativeMapping mapping){
+	switch (mapping){
+		case NegativeMapping::ONESCOMP:
+			return GenericDecoderOf<T, N, BigEndian, correct_sign_onescomp>::get();
+		case NegativeMapping::SIGNBIT:
+			return GenericDecoderOf<T, N, BigEndian, correct_sign_signbit>::get();
+		case NegativeMapping::EXCESSKBIASED:
+			return GenericDecoderOf<T, N, BigEndian, correct_sign_excessk_biased>::get();
+		default:
+			return GenericDecoderOf<T, N, BigEndian, correct_sign_twoscomp>::get();
+	}
+}
+
+template <typename T, unsigned N>
+static GenericDecoder select_decoder(const DefinedInteger &integer){
+	if (integer.get_endianness() == Endianness::BIG)
+		return select_decoder<T, N, true>(integer.get_negative_mapping());
+	return select_decoder<T, N, false>(integer.get_negative_mapping());
+}
+
+static GenericDecoder select_decoder(const DefinedInteger &integer){
+	switch (integer.get_int_type_id()){
+		case 1 << 1:
+			return select_decoder<uint8_t, 1>(integer);
+		case (1 << 1) | 1:
+			return select_decoder<int8_t, 1>(integer);
+		case 2 << 1:
+			return select_decoder<uint16_t, 2>(integer);
+		case (2 << 1) | 1:
+			return select_decoder<int16_t, 2>(integer);
+		case 4 << 1:
+			return select_decoder<uint32_t, 4>(integer);
+		case (4 << 1) | 1:
+			return select_decoder<int32_t, 4>(integer);
+		case 8 << 1:
+			return select_decoder<uint64_t, 8>(integer);
+		case (8 << 1) | 1:
+			return select_decoder<int64_t, 8>(integer);
+	}
+	throw Parser::MetaParserStatus::DATUM_NOT_PROPERLY_DEFINED;
+}
+
+/*
+Values in the spec are C++ expressions, pasted as they are into the
+generated code. The interpreter only understands integer literals, with
+their suffixes, and string literals without escapes.
+*/
+static uint64_t parse_integer_literal(std::string value, bool is_signed){
+	while (value.size() && strchr("uUlL", value.back()))
+		value.pop_back();
+	auto begin = value.c_str();
+	char *end;
+	errno = 0;
+	uint64_t ret;
+	if (is_signed)
+		ret = (uint64_t)strtoll(begin, &end, 0);
+	else if (value.find('-') != value.npos)
+		throw Parser::MetaParserStatus::COULD_NOT_UNDERSTAND_VALUE;
+	else
+		ret = strtoull(begin, &end, 0);
+	if (end == begin || *end || errno == ERANGE)
+		throw Parser::MetaParserStatus::COULD_NOT_UNDERSTAND_VALUE;
+	return ret;
+}
+
+static std::string parse_string_literal(const std::string &value){
+	if (value.size() < 2 || value.front() != '"' || value.back() != '"' || value.find('\\') != value.npos)
+		throw Parser::MetaParserStatus::COULD_NOT_UNDERSTAND_VALUE;
+	return value.substr(1, value.size() - 2);
+}
+
+//-----------------------------------------------------------------------------
+
+BytecodeProgram::BytecodeProgram(const DefinedType &type): integer_count(0), string_count(0), array_count(0){
+	for (auto &ns : type.get_namespaces()){
+		this->name.append(ns);
+		this->name.append("::");
+	}
+	this->name.append(type.get_name());
+	auto &data = type.get_data();
+	for (size_t i = 0; i < data.size();){
+		auto d = data[i].get();
+		switch (d->get_type()){
+			case DataType::INTEGER:
+				{
+					std::vector<const DefinedInteger *> integers;
+					for (; i < data.size() && data[i]->get_type() == DataType::INTEGER; i++)
+						integers.push_back((const DefinedInteger *)data[i].get());
+					this->compile_integers(&integers[0], integers.size());
+				}
+				continue;
+			case DataType::STRING:
+				{
+					Opcode op = Opcode::READ_STRING_FIXED;
+					auto length = this->compile_length(*d->get_length(), op);
+					auto slot = this->string_count;
+					this->add_field(d->get_name(), GenericDataType::STRING, this->string_count);
+					this->emit(op, slot, length);
+					if (auto req = d->get_requirement()){
+						if (req->get_relation() == Requirement::Relation::NONE)
+							throw Parser::MetaParserStatus::EXPECTED_RELATIONAL_OPERATOR;
+						this->emit(Opcode::CHECK_STRING, slot, this->string_constants.size(), (uint8_t)req->get_relation());
+						this->string_constants.push_back(parse_string_literal(req->get_value()));
+					}
+				}
+				break;
+			case DataType::ARRAY:
+				{
+					Opcode op = Opcode::READ_ARRAY_FIXED;
+					auto length = this->compile_length(*d->get_length(), op);
+					auto decoder = this->add_decoder(select_decoder(*((const DefinedArray *)d)->get_element_type()));
+					auto slot = this->array_count;
+					this->add_field(d->get_name(), GenericDataType::ARRAY, this->array_count);
+					this->emit(op, slot, length, decoder);
+				}
+				break;
+			default:
+				throw Parser::MetaParserStatus::DATUM_NOT_PROPERLY_DEFINED;
+		}
+		i++;
+	}
+	this->emit(Opcode::END);
+	IntegerRun none = { 0, 0, 0, 0, 0, 0, 0, RunLayout::MIXED };
+	this->single_run = this->code.size() == 2 && this->code.front().op == Opcode::LOAD_RUN ? this->runs.front() : none;
+}
+
+void BytecodeProgram::add_field(const std::string &name, GenericDataType type, unsigned &count){
+	GenericField field = { name, type, count++ };
+	this->fields.push_back(field);
+}
+
+uint8_t BytecodeProgram::add_decoder(const GenericDecoder &decoder){
+	for (size_t i = 0; i < this->decoders.size(); i++)
+		if (this->decoders[i].decode == decoder.decode)
+			return (uint8_t)i;
+	// There are only so many kinds of integers.
+	assert(this->decoders.size() < 0x100);
+	this->decoders.push_back(decoder);
+	return (uint8_t)(this->decoders.size() - 1);
+}
+
+static bool is_mapped(const DefinedInteger &integer){
+	return integer.get_signedness() && integer.get_negative_mapping() != NegativeMapping::TWOSCOMP;
+}
+
+// Returns false for a requirement that every value meets, which needs no
+// check.
+static bool compile_check(RunCheck &dst, const Requirement &req, uint32_t field, bool is_signed){
+	if (req.get_relation() == Requirement::Relation::NONE)
+		throw Parser::MetaParserStatus::EXPECTED_RELATIONAL_OPERATOR;
+	// Signed values are moved into the order of the unsigned ones.
+	uint64_t bias = is_signed ? (uint64_t)1 << 63 : 0,
+		value = parse_integer_literal(req.get_value(), is_signed) ^ bias;
+	dst.low = 0;
+	dst.field = field;
+	switch (req.get_relation()){
+		case Requirement::Relation::EQ:
+			dst.low = value;
+			dst.count = 1;
+			break;
+		case Requirement::Relation::NEQ:
+			dst.low = value + 1;
+			dst.count = ~(uint64_t)0;
+			break;
+		case Requirement::Relation::LT:
+			dst.count = value;
+			break;
+		case Requirement::Relation::GT:
+			dst.low = value + 1;
+			dst.count = ~value;
+			break;
+		case Requirement::Relation::GEQ:
+			if (!value)
+				return 0;
+			dst.low = value;
+			dst.count = 0 - value;
+			break;
+		default:
+			if (value == ~(uint64_t)0)
+				return 0;
+			dst.count = value + 1;
+			break;
+	}
+	// Subtracting the bias is the same as flipping it.
+	dst.low ^= bias;
+	return 1;
+}
+
+// Consecutive integers make up a single run. See IntegerRun.
+void BytecodeProgram::compile_integers(const DefinedInteger *const *integers, size_t count){
+	IntegerRun run = {
+		(uint32_t)this->run_fields.size(),
+		(uint32_t)count,
+		(uint32_t)this->run_checks.size(),
+		0,
+		0,
+		0,
+		0,
+		integers[0]->get_endianness() == Endianness::BIG ? RunLayout::BIG : RunLayout::LITTLE,
+	};
+	this->run_fields.resize(run.first_pair + (count + 1) / 2);
+	auto first_slot = this->integer_count;
+	for (size_t i = 0; i < count; i++){
+		auto &integer = *integers[i];
+		unsigned size = integer.get_size();
+		auto &pair = this->run_fields[run.first_pair + i / 2];
+		auto lane = i % 2;
+		pair.mask[lane] = size < 8 ? ((uint64_t)1 << 8 * size) - 1 : ~(uint64_t)0;
+		if (integer.get_signedness())
+			pair.sign_bit[lane] = (uint64_t)1 << (8 * size - 1);
+		uint64_t position = (uint64_t)run.size << 6 | (64 - 8 * size);
+		if (integer.get_endianness() == Endianness::BIG){
+			// A pair is shifted if its first field ends within the first
+			// word, since the word that ends with it would start before the
+			// run.
+			if (!lane && run.size + size < 8)
+				run.shifted_pairs = (uint32_t)(i / 2 + 1);
+			if (run.shifted_pairs > i / 2){
+				// The shift extends the sign.
+				if (integer.get_signedness())
+					pair.mask[lane] = ~(uint64_t)0;
+			}else
+				position = (uint64_t)(run.size + size - 8) << 6;
+		}
+		pair.positions |= position << 32 * lane;
+		pair.decoder[lane] = this->add_decoder(select_decoder(integer));
+		if (is_mapped(integer) || integer.get_endianness() != integers[0]->get_endianness())
+			run.layout = RunLayout::MIXED;
+		run.padded_size = run.size + 8;
+		run.size += size;
+		auto req = integer.get_requirement();
+		RunCheck check;
+		if (req && compile_check(check, *req, (uint32_t)i, integer.get_signedness())){
+			this->run_checks.push_back(check);
+			run.check_count++;
+		}
+		this->add_field(integer.get_name(), GenericDataType::INTEGER, this->integer_count);
+	}
+	this->emit(Opcode::LOAD_RUN, first_slot, this->runs.size());
+	this->runs.push_back(run);
+}
+
+// op is the opcode for a fixed length. Changes it to the one for the actual
+// kind of length, and returns the argument for it.
+uint64_t BytecodeProgram::compile_length(const ArrayLength &length, Opcode &op){
+	if (length.is_fixed())
+		return parse_integer_literal(((const FixedArrayLength &)length).length, 0);
+	if (!strcmp(length.get_length_word(), "cstyle")){
+		op = (Opcode)((unsigned)op + 2);
+		return 0;
+	}
+	auto dependency = length.get_dependency();
+	if (!dependency || strcmp(length.get_length_word(), "sized"))
+		throw Parser::MetaParserStatus::INVALID_LENGTH_SPECIFICATION;
+	// Only integers read before the datum can be its length.
+	auto field = this->find_field(*dependency);
+	if (!field || field->type != GenericDataType::INTEGER)
+		throw Parser::MetaParserStatus::EXPECTED_LENGTH_NAME;
+	op = (Opcode)((unsigned)op + 1);
+	return field->slot;
+}
+
+const GenericField *BytecodeProgram::find_field(const std::string &name) const{
+	for (auto &field : this->fields)
+		if (field.name == name)
+			return &field;
+	return nullptr;
+}
+
+Parser::MetaParserStatus Parser::compile_bytecode(std::vector<BytecodeProgram> &dst) const{
+	dst.clear();
+	try{
+		for (auto &type : this->types)
+			dst.push_back(BytecodeProgram(*type));
+	}catch (const Parser::MetaParserStatus &status){
+		return status;
+	}
+	return MetaParserStatus::SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+static bool compare(uint8_t relation, const T &a, const T &b){
+	switch ((Requirement::Relation)relation){
+		case Requirement::Relation::EQ:
+			return a == b;
+		case Requirement::Relation::NEQ:
+			return a != b;
+		case Requirement::Relation::LT:
+			return a < b;
+		case Requirement::Relation::GT:
+			return a > b;
+		case Requirement::Relation::LEQ:
+			return a <= b;
+		case Requirement::Relation::GEQ:
+			return a >= b;
+		default:
+			return 1;
+	}
+}
+
+// Returns how many fields could be read before end.
+static uint32_t decode_run(int64_t *dst, const FieldPair *pairs, uint32_t count, const GenericDecoder *decoders, const uint8_t *p, const uint8_t *end){
+	for (uint32_t i = 0; i < count; i++){
+		auto &decoder = decoders[pairs[i / 2].decoder[i % 2]];
+		if ((size_t)(end - p) < decoder.size)
+			return i;
+		dst[i] = decoder.decode(p);
+		p += decoder.size;
+	}
+	return count;
+}
+
+// Only the checks on the first count fields are made.
+static bool check_run(const int64_t *integers, const RunCheck *checks, uint32_t check_count, uint32_t count){
+	for (uint32_t i = 0; i < check_count; i++)
+		if (checks[i].field < count && !meets_check(integers, checks[i]))
+			return 0;
+	return 1;
+}
+
+/*
+Without Check, requirements aren't checked. Like in the generated code, a
+requirement that fails is reported before the input running out after it.
+*/
+template <bool Check>
+static BIN_INLINE ParserStatus load_run(int64_t *dst, const IntegerRun &run, const FieldPair *pairs, const RunCheck *checks, const GenericDecoder *decoders, const uint8_t *p, const uint8_t *end){
+	pairs += run.first_pair;
+	checks += run.first_check;
+	if (BIN_LIKELY(has_run_words(run, p, end)))
+		return decode_run_words<Check>(dst, run, pairs, checks, p) ? ParserStatus::SUCCESS : ParserStatus::REQUIREMENT_NOT_MET;
+	auto count = decode_run(dst, pairs, run.field_count, decoders, p, end);
+	if (Check && run.check_count && !check_run(dst, checks, run.check_count, count))
+		return ParserStatus::REQUIREMENT_NOT_MET;
+	return count == run.field_count ? ParserStatus::SUCCESS : ParserStatus::UNEXPECTED_EOF;
+}
+
+/*
+Every op ends by dispatching the next one. Where the compiler can take the
+address of a label, each op has an indirect jump of its own, which the CPU
+predicts far better than the single jump of a switch.
+*/
+#if defined(__GNUC__)
+#define BIN_THREADED_DISPATCH
+#define BIN_OP(op) op_##op:
+#define BIN_NEXT goto *labels[(unsigned)(++i)->op]
+#else
+#define BIN_OP(op) case Opcode::op:
+#define BIN_NEXT i++; continue
+#endif
+
+ParserStatus BytecodeProgram::execute(GenericRecord &record, const uint8_t *&begin, const uint8_t *end) const{
+#ifdef BIN_THREADED_DISPATCH
+	// In the order of Opcode.
+	static const void *labels[] = {
+		&&op_LOAD_RUN,
+		&&op_CHECK_STRING,
+		&&op_READ_STRING_FIXED,
+		&&op_READ_STRING_SIZED,
+		&&op_READ_STRING_CSTYLE,
+		&&op_READ_ARRAY_FIXED,
+		&&op_READ_ARRAY_SIZED,
+		&&op_READ_ARRAY_CSTYLE,
+		&&op_END,
+	};
+	static_assert(sizeof(labels) / sizeof(*labels) == (size_t)Opcode::END + 1, "The labels don't match the opcodes.");
+#endif
+	// The record is usually left from reading the same type.
+	if (BIN_UNLIKELY(
+			record.integers.size() != this->integer_count ||
+			record.strings.size() != this->string_count ||
+			record.arrays.size() != this->array_count)){
+		record.integers.resize(this->integer_count);
+		record.strings.resize(this->string_count);
+		record.arrays.resize(this->array_count);
+	}
+	auto integers = record.integers.data();
+	auto p = begin;
+	auto i = this->code.data();
+#ifdef BIN_THREADED_DISPATCH
+	goto *labels[(unsigned)i->op];
+#else
+	while (1){
+		switch (i->op){
+#endif
+			BIN_OP(LOAD_RUN)
+				{
+					auto &run = this->runs[i->arg];
+					auto status = load_run<true>(integers + i->slot, run, this->run_fields.data(), this->run_checks.data(), this->decoders.data(), p, end);
+					if (BIN_UNLIKELY(status != ParserStatus::SUCCESS))
+						return status;
+					p += run.size;
+				}
+				BIN_NEXT;
+			BIN_OP(CHECK_STRING)
+				if (BIN_UNLIKELY(!compare(i->aux, record.strings[i->slot], this->string_constants[i->arg])))
+					return ParserStatus::REQUIREMENT_NOT_MET;
+				BIN_NEXT;
+			BIN_OP(READ_STRING_FIXED)
+			BIN_OP(READ_STRING_SIZED)
+				{
+					auto length = i->op == Opcode::READ_STRING_FIXED ? i->arg : (uint64_t)integers[i->arg];
+					if (BIN_UNLIKELY((uint64_t)(end - p) < length))
+						return ParserStatus::UNEXPECTED_EOF;
+					record.strings[i->slot].assign((const char *)p, (size_t)length);
+					p += length;
+				}
+				BIN_NEXT;
+			BIN_OP(READ_STRING_CSTYLE)
+				{
+					auto terminator = (const uint8_t *)memchr(p, 0, end - p);
+					if (BIN_UNLIKELY(!terminator))
+						return ParserStatus::UNEXPECTED_EOF;
+					record.strings[i->slot].assign((const char *)p, terminator - p);
+					p = terminator + 1;
+				}
+				BIN_NEXT;
+			BIN_OP(READ_ARRAY_FIXED)
+			BIN_OP(READ_ARRAY_SIZED)
+				{
+					auto &decoder = this->decoders[i->aux];
+					auto count = i->op == Opcode::READ_ARRAY_FIXED ? i->arg : (uint64_t)integers[i->arg];
+					if (BIN_UNLIKELY(count > (uint64_t)(end - p) / decoder.size))
+						return ParserStatus::UNEXPECTED_EOF;
+					auto &array = record.arrays[i->slot];
+					array.resize((size_t)count);
+					if (count)
+						decoder.decode_array(&array[0], p, (size_t)count);
+					p += count * decoder.size;
+				}
+				BIN_NEXT;
+			BIN_OP(READ_ARRAY_CSTYLE)
+				{
+					auto &decoder = this->decoders[i->aux];
+					auto &array = record.arrays[i->slot];
+					array.clear();
+					while (1){
+						if (BIN_UNLIKELY((size_t)(end - p) < decoder.size))
+							return ParserStatus::UNEXPECTED_EOF;
+						auto x = decoder.decode(p);
+						p += decoder.size;
+						if (!x)
+							break;
+						array.push_back(x);
+					}
+				}
+				BIN_NEXT;
+			BIN_OP(END)
+				begin = p;
+				return ParserStatus::SUCCESS;
+#ifndef BIN_THREADED_DISPATCH
+		}
+	}
+#endif
+}
+
+#undef BIN_OP
+#undef BIN_NEXT
+
+ParserStatus BytecodeProgram::run(GenericRecord &record, MemorySource &stream) const{
+	size_t available = stream.available();
+	while (1){
+		auto begin = stream.get(),
+			p = begin;
+		auto ret = this->run(record, p, begin + available);
+		if (ret == ParserStatus::SUCCESS)
+			stream.consume(p - begin);
+		// The record may go on past what the source holds right now.
+		if (ret != ParserStatus::UNEXPECTED_EOF || !stream.ensure(available + 1))
+			return ret;
+		available = stream.available();
+	}
+}
+
+bool BytecodeProgram::skip(GenericRecord &record, const uint8_t *&begin, const uint8_t *end) const{
+	if (BIN_UNLIKELY(record.integers.size() != this->integer_count))
+		record.integers.resize(this->integer_count);
+	auto integers = record.integers.data();
+	auto p = begin;
+	for (auto i = this->code.data();; i++){
+		switch (i->op){
+			case Opcode::LOAD_RUN:
+				{
+					auto &run = this->runs[i->arg];
+					if (load_run<false>(integers + i->slot, run, this->run_fields.data(), this->run_checks.data(), this->decoders.data(), p, end) != ParserStatus::SUCCESS)
+						return 0;
+					p += run.size;
+				}
+				break;
+			case Opcode::CHECK_STRING:
+				break;
+			case Opcode::READ_STRING_FIXED:
+			case Opcode::READ_STRING_SIZED:
+				{
+					auto length = i->op == Opcode::READ_STRING_FIXED ? i->arg : (uint64_t)integers[i->arg];
+					if (BIN_UNLIKELY((uint64_t)(end - p) < length))
+						return 0;
+					p += length;
+				}
+				break;
+			case Opcode::READ_STRING_CSTYLE:
+				{
+					auto terminator = (const uint8_t *)memchr(p, 0, end - p);
+					if (BIN_UNLIKELY(!terminator))
+						return 0;
+					p = terminator + 1;
+				}
+				break;
+			case Opcode::READ_ARRAY_FIXED:
+			case Opcode::READ_ARRAY_SIZED:
+				{
+					auto size = this->decoders[i->aux].size;
+					auto count = i->op == Opcode::READ_ARRAY_FIXED ? i->arg : (uint64_t)integers[i->arg];
+					if (BIN_UNLIKELY(count > (uint64_t)(end - p) / size))
+						return 0;
+					p += count * size;
+				}
+				break;
+			case Opcode::READ_ARRAY_CSTYLE:
+				{
+					auto &decoder = this->decoders[i->aux];
+					while (1){
+						if (BIN_UNLIKELY((size_t)(end - p) < decoder.size))
+							return 0;
+						auto x = decoder.decode(p);
+						p += decoder.size;
+						if (!x)
+							break;
+					}
+				}
+				break;
+			case Opcode::END:
+				begin = p;
+				return 1;
+		}
+	}
+}
+
+bool BytecodeProgram::skip(GenericRecord &record, MemorySource &stream) const{
+	size_t available = stream.available();
+	while (1){
+		auto begin = stream.get(),
+			p = begin;
+		if (this->skip(record, p, begin + available)){
+			stream.consume(p - begin);
+			return 1;
+		}
+		if (!stream.ensure(available + 1))
+			return 0;
+		available = stream.available();
+	}
+}
@@ -0,0 +1,329 @@
+/*
+Copyright (c) 2014 Helios (helios.vmg@gmail.com)
+
+This software is provided 'as-is', in the hope that it will be useful, but
+without any express or implied warranty. In no event will the authors be held
+liable for any damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose, including
+commercial applications, and to alter it and redistribute it freely, subject to
+the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would
+       be appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not
+       be misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+       distribution.
+
+    4. The user is granted all rights over the textual output of this
+       software.
+
+*/
+
+/*
+The interpreter parses the types of a spec loaded at runtime, without
+generating any code. Parser::compile_bytecode() turns each type into a
+BytecodeProgram, a flat array of instructions, which run() executes over a
+buffer to fill in a GenericRecord. library.h must be included first.
+*/
+
+class DefinedType;
+class DefinedInteger;
+class ArrayLength;
+
+/*
+The data of a record, by kind, each kind in the order the data are declared
+in. Integers, including the elements of arrays, are widened to 64 bits, and
+unsigned ones keep their bits. Reading over the same record reuses the
+memory of its strings and arrays.
+*/
+struct GenericRecord{
+	std::vector<int64_t> integers;
+	std::vector<std::string> strings;
+	std::vector<std::vector<int64_t> > arrays;
+};
+
+enum class GenericDataType{
+	INTEGER,
+	STRING,
+	ARRAY,
+};
+
+// Where a datum of a type is kept in a GenericRecord.
+struct GenericField{
+	std::string name;
+	GenericDataType type;
+	unsigned slot;
+};
+
+enum class Opcode : uint8_t{
+	// Load runs[arg] into integers[slot] onwards.
+	LOAD_RUN,
+	// Compare strings[slot] with string_constants[arg], with the relation
+	// in aux.
+	CHECK_STRING,
+	// Read strings[slot]. The length is arg, or integers[arg], or runs up
+	// to a NUL. The compiler relies on the order of the three.
+	READ_STRING_FIXED,
+	READ_STRING_SIZED,
+	READ_STRING_CSTYLE,
+	// Read arrays[slot] through decoders[aux], with lengths as above.
+	READ_ARRAY_FIXED,
+	READ_ARRAY_SIZED,
+	READ_ARRAY_CSTYLE,
+	END,
+};
+
+struct Instruction{
+	Opcode op;
+	uint8_t aux;
+	uint32_t slot;
+	uint64_t arg;
+};
+
+/*
+A run is a sequence of consecutive integers, which are read after a single
+bounds check, and whose requirements are checked once all of them have been
+decoded. If every field is unsigned or two's complement, and of the same
+byte order, each is decoded without branches from the 8 byte word it
+starts, read as little endian. A little endian field is masked and its sign
+extended through sign_bit, two fields at a time where there is SSE2. A
+big endian field is swapped from the word that ends with it, and then
+masked and extended the same way, except in the pairs that start in the
+first word of the run, where it's swapped from the word it starts and
+shifted down arithmetically, and masked if it is unsigned. Near the end of
+the input, or for the other runs, each field is decoded through its own
+decoder instead.
+*/
+enum class RunLayout : uint8_t{
+	LITTLE,
+	BIG,
+	MIXED,
+};
+
+// Two consecutive fields of a run, side by side, so that they can be decoded
+// at once. Every run starts a new pair.
+struct alignas(16) FieldPair{
+	uint64_t mask[2],
+		sign_bit[2],
+		// 32 bits for each field, the first one in the low half: the offset
+		// of its word times 64, plus the shift of a big endian field, so that
+		// one load gets both.
+		positions;
+	uint8_t decoder[2];
+};
+
+/*
+Every relation is a range of count values from low, which wraps around for
+signed fields and for inequality. A check passes if
+(uint64_t)integers[field] - low < count.
+*/
+struct RunCheck{
+	uint64_t low,
+		count;
+	uint32_t field;
+};
+
+struct IntegerRun{
+	uint32_t first_pair,
+		field_count,
+		first_check,
+		check_count,
+		size,
+		// The bytes it takes to read every word.
+		padded_size,
+		// The pairs of a big endian run whose fields are shifted.
+		shifted_pairs;
+	RunLayout layout;
+};
+
+struct GenericDecoder{
+	unsigned size;
+	int64_t (*decode)(const uint8_t *);
+	void (*decode_array)(int64_t *dst, const uint8_t *src, size_t count);
+};
+
+// The decoding of runs from their words is inlined through run() into the
+// caller, which reads most records of integers alone without a call.
+#if defined(_MSC_VER)
+#define BIN_INLINE __forceinline
+#elif defined(__GNUC__)
+#define BIN_INLINE inline __attribute__((always_inline))
+#else
+#define BIN_INLINE inline
+#endif
+
+inline uint64_t load_little_endian_word(const uint8_t *p){
+	uint64_t ret;
+	memcpy(&ret, p, sizeof(ret));
+	if (BIN_HOST_IS_BIG_ENDIAN)
+		ret = byte_swap(ret);
+	return ret;
+}
+
+#define BIN_SHIFT_BIG_ENDIAN(i, position) \
+	dst[i] = (int64_t)((uint64_t)((int64_t)byte_swap(load_little_endian_word(p + ((position) >> 6))) >> ((position) & 63)) & pairs->mask[i])
+
+#define BIN_MASK_BIG_ENDIAN(i, position) \
+	{ \
+		auto x = byte_swap(load_little_endian_word(p + ((position) >> 6))) & pairs->mask[i]; \
+		dst[i] = (int64_t)((x ^ pairs->sign_bit[i]) - pairs->sign_bit[i]); \
+	}
+
+// See RunLayout. The input must hold the padded size of the run.
+BIN_INLINE void decode_big_endian_words(int64_t *dst, const FieldPair *pairs, uint32_t count, uint32_t shifted_pairs, const uint8_t *p){
+	for (; count >= 2 && shifted_pairs; count -= 2, dst += 2, pairs++, shifted_pairs--){
+		auto positions = pairs->positions;
+		BIN_SHIFT_BIG_ENDIAN(0, (uint32_t)positions);
+		BIN_SHIFT_BIG_ENDIAN(1, positions >> 32);
+	}
+	for (; count >= 2; count -= 2, dst += 2, pairs++){
+		auto positions = pairs->positions;
+		BIN_MASK_BIG_ENDIAN(0, (uint32_t)positions)
+		BIN_MASK_BIG_ENDIAN(1, positions >> 32)
+	}
+	if (!count)
+		return;
+	if (shifted_pairs)
+		BIN_SHIFT_BIG_ENDIAN(0, (uint32_t)pairs->positions);
+	else
+		BIN_MASK_BIG_ENDIAN(0, (uint32_t)pairs->positions)
+}
+
+#undef BIN_SHIFT_BIG_ENDIAN
+#undef BIN_MASK_BIG_ENDIAN
+
+// A pair of fields fills an SSE2 register whatever the widest vector
+// extension is, so pairs are decoded with SSE2 directly rather than through
+// BIN_VECTOR.
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86_FP) && _M_IX86_FP >= 2
+#define BIN_DECODE_PAIRS
+#define BIN_DECODE_LITTLE_ENDIAN(i) \
+	{ \
+		auto positions = pairs[i].positions; \
+		auto x = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(p + ((uint32_t)positions >> 6))), _mm_loadl_epi64((const __m128i *)(p + (positions >> 38)))); \
+		x = _mm_and_si128(x, _mm_load_si128((const __m128i *)pairs[i].mask)); \
+		auto sign = _mm_and_si128(x, _mm_load_si128((const __m128i *)pairs[i].sign_bit)); \
+		_mm_storeu_si128((__m128i *)dst + i, _mm_sub_epi64(x, _mm_add_epi64(sign, sign))); \
+	}
+#endif
+
+BIN_INLINE void decode_little_endian_words(int64_t *dst, const FieldPair *pairs, uint32_t count, const uint8_t *p){
+#ifdef BIN_DECODE_PAIRS
+	for (; count >= 4; count -= 4, dst += 4, pairs += 2){
+		BIN_DECODE_LITTLE_ENDIAN(0)
+		BIN_DECODE_LITTLE_ENDIAN(1)
+	}
+	if (count >= 2){
+		BIN_DECODE_LITTLE_ENDIAN(0)
+		count -= 2;
+		dst += 2;
+		pairs++;
+	}
+#endif
+	for (uint32_t i = 0; i < count; i++){
+		auto &pair = pairs[i / 2];
+		auto lane = i % 2;
+		auto x = load_little_endian_word(p + ((uint32_t)(pair.positions >> 32 * lane) >> 6)) & pair.mask[lane];
+		dst[i] = (int64_t)((x ^ pair.sign_bit[lane]) - pair.sign_bit[lane]);
+	}
+}
+
+#undef BIN_DECODE_LITTLE_ENDIAN
+
+inline bool meets_check(const int64_t *integers, const RunCheck &check){
+	return (uint64_t)integers[check.field] - check.low < check.count;
+}
+
+// Decodes a run from its words, which the input must hold, and returns
+// whether it meets its requirements. pairs and checks are those of the run.
+template <bool Check>
+BIN_INLINE bool decode_run_words(int64_t *dst, const IntegerRun &run, const FieldPair *pairs, const RunCheck *checks, const uint8_t *p){
+	if (run.layout == RunLayout::BIG)
+		decode_big_endian_words(dst, pairs, run.field_count, run.shifted_pairs, p);
+	else
+		decode_little_endian_words(dst, pairs, run.field_count, p);
+	if (Check){
+		bool failed = 0;
+		for (uint32_t i = 0; i < run.check_count; i++)
+			failed |= !meets_check(dst, checks[i]);
+		return !failed;
+	}
+	return 1;
+}
+
+inline bool has_run_words(const IntegerRun &run, const uint8_t *p, const uint8_t *end){
+	return run.layout != RunLayout::MIXED && (size_t)(end - p) >= run.padded_size;
+}
+
+class BytecodeProgram{
+	std::string name;
+	std::vector<Instruction> code;
+	std::vector<IntegerRun> runs;
+	// The only run of a type of integers alone, which run() reads without
+	// dispatching. For other types, its layout is MIXED.
+	IntegerRun single_run;
+	std::vector<FieldPair> run_fields;
+	std::vector<RunCheck> run_checks;
+	std::vector<GenericDecoder> decoders;
+	std::vector<std::string> string_constants;
+	std::vector<GenericField> fields;
+	unsigned integer_count,
+		string_count,
+		array_count;
+
+	void emit(Opcode op, uint32_t slot = 0, uint64_t arg = 0, uint8_t aux = 0){
+		Instruction i = { op, aux, slot, arg };
+		this->code.push_back(i);
+	}
+	uint8_t add_decoder(const GenericDecoder &);
+	void add_field(const std::string &name, GenericDataType type, unsigned &count);
+	void compile_integers(const DefinedInteger *const *integers, size_t count);
+	uint64_t compile_length(const ArrayLength &, Opcode &op);
+	// Runs the code, without the shortcut for integers alone.
+	ParserStatus execute(GenericRecord &, const uint8_t *&p, const uint8_t *end) const;
+public:
+	// Throws Parser::MetaParserStatus if the type uses something the
+	// interpreter can't evaluate, such as a requirement on an expression.
+	BytecodeProgram(const DefinedType &);
+	// The name of the type, qualified with its namespaces.
+	const std::string &get_name() const{
+		return this->name;
+	}
+	const std::vector<GenericField> &get_fields() const{
+		return this->fields;
+	}
+	const GenericField *find_field(const std::string &name) const;
+	const std::vector<Instruction> &get_code() const{
+		return this->code;
+	}
+	// Reads one record from [p, end) and moves p past it. p is left alone
+	// if the record can't be read.
+	ParserStatus run(GenericRecord &, const uint8_t *&p, const uint8_t *end) const;
+	// Consumes the record from stream only if it could be read.
+	ParserStatus run(GenericRecord &, MemorySource &stream) const;
+	// Moves past one record like the generated skip(), without building it
+	// or checking its requirements. Only the integers of the record are
+	// decoded, for the lengths that depend on them.
+	bool skip(GenericRecord &, const uint8_t *&p, const uint8_t *end) const;
+	bool skip(GenericRecord &, MemorySource &stream) const;
+};
+
+BIN_INLINE ParserStatus BytecodeProgram::run(GenericRecord &record, const uint8_t *&begin, const uint8_t *end) const{
+	// A type of integers alone is a single run, which is read here without
+	// dispatching, unless it has to be read field by field. Its pairs and
+	// checks are the first ones.
+	auto &run = this->single_run;
+	if (BIN_LIKELY(has_run_words(run, begin, end) && record.integers.size() == this->integer_count && record.strings.empty() && record.arrays.empty())){
+		if (BIN_UNLIKELY(!decode_run_words<true>(record.integers.data(), run, this->run_fields.data(), this->run_checks.data(), begin)))
+			return ParserStatus::REQUIREMENT_NOT_MET;
+		begin += run.size;
+		return ParserStatus::SUCCESS;
+	}
+	return this->execute(record, begin, end);
+}
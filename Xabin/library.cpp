@@ -25,53 +25,50 @@ the following restrictions:
 
 */
 #include "library.h"
+#include <algorithm>
+#include <map>
+#include <cstdio>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-template <typename T>
-class auto_array_ptr
-{
-	T *pointer;
-public:
-	auto_array_ptr(T *p = 0): pointer(p), func(0){}
-	~auto_array_ptr()
-	{
-		reset();
-	}
-	void reset(T *p = 0)
-	{
-		delete[] pointer;
-		pointer = p;
-	}
-	operator bool() const
-	{
-		return !!pointer;
-	}
-	bool operator!() const
-	{
-		return !pointer;
-	}
-	T *get()
-	{
-		return pointer;
-	}
-};
+#ifdef BIN_USE_EXCEPTIONS
+void throw_parsing_exception(ParserStatus status){
+	throw ParsingException(status);
+}
+#endif
 
-#define BIN_USE_EXCEPTIONS
+const char *ParsingException::what() const noexcept{
+	switch (this->status){
+		case ParserStatus::SUCCESS:
+			return "success";
+		case ParserStatus::UNEXPECTED_EOF:
+			return "unexpected end of input";
+		case ParserStatus::REQUIREMENT_NOT_MET:
+			return "requirement not met";
+		case ParserStatus::ALLOCATION_ERROR:
+			return "allocation error";
+		case ParserStatus::INCOMPLETE:
+			return "incomplete record";
+	}
+	return "unknown parsing error";
+}
 
-BIN_FUNCTION_SIGNATURE(std::string, read_sized_string, size_t length, std::istream &stream){
+BIN_FUNCTION_SIGNATURE(std::string, read_sized_string, std::istream &stream, size_t length){
 #ifdef BIN_USE_EXCEPTIONS
-	auto_array_ptr<char> temp(new char[length]);
-	stream.read(temp.get(), length);
-	if (stream.gcount() < length)
+	std::string temp;
+	if (BIN_UNLIKELY(!assign_sized_string(temp, stream, length)))
 		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
-	return std::string(temp.get(), length);
+	return temp;
 #else
-	auto_array_ptr<char> temp(new (std::nothrow) char[length]);
-	if (!temp)
-		BIN_HURL_ERROR(ParserStatus::ALLOCATION_ERROR);
-	stream.read(temp.get(), length);
-	if (stream.gcount() < length)
+	if (BIN_UNLIKELY(!assign_sized_string(dst, stream, length)))
 		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
-	dst.assign(temp.get(), length);
 	return ParserStatus::SUCCESS;
 #endif
 }
@@ -79,24 +76,12 @@ BIN_FUNCTION_SIGNATURE(std::string, read_sized_string, size_t length, std::istre
 BIN_FUNCTION_SIGNATURE(std::string, read_cstyle_string, std::istream &stream){
 #ifdef BIN_USE_EXCEPTIONS
 	std::string temp;
-	while (1){
-		char c = stream.get();
-		if (!stream)
-			BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
-		if (!c)
-			break;
-		temp.push_back(c);
-	}
+	if (BIN_UNLIKELY(!assign_cstyle_string(temp, stream)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
 	return temp;
 #else
-	while (1){
-		char c = stream.get();
-		if (!stream)
-			BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
-		if (!c)
-			break;
-		dst.push_back(c);
-	}
+	if (BIN_UNLIKELY(!assign_cstyle_string(dst, stream)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
 	return ParserStatus::SUCCESS;
 #endif
 }
@@ -106,4 +91,378 @@ BIN_FUNCTION_SIGNATURE(std::string, read_user_length_string, std::istream &strea
 #else
 #endif
 }
-*/
\ No newline at end of file
+*/
+
+//-----------------------------------------------------------------------------
+
+static uint64_t get_mapping_granularity(){
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+#else
+	return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+MappedFileSource::MappedFileSource(const char *path, size_t window_size):
+		file_size(0),
+		window_size(window_size),
+		window(nullptr),
+		window_length(0){
+#ifdef _WIN32
+	this->mapping = nullptr;
+	this->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (this->file == INVALID_HANDLE_VALUE)
+		return;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(this->file, &size)){
+		CloseHandle(this->file);
+		this->file = INVALID_HANDLE_VALUE;
+		return;
+	}
+	this->file_size = size.QuadPart;
+	if (this->file_size)
+		this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+#else
+	this->fd = open(path, O_RDONLY);
+	if (this->fd < 0)
+		return;
+	struct stat st;
+	if (fstat(this->fd, &st) < 0){
+		close(this->fd);
+		this->fd = -1;
+		return;
+	}
+	this->file_size = st.st_size;
+#endif
+	this->map(0, 0);
+}
+
+MappedFileSource::~MappedFileSource(){
+	this->unmap();
+#ifdef _WIN32
+	if (this->mapping)
+		CloseHandle(this->mapping);
+	if (this->file != INVALID_HANDLE_VALUE)
+		CloseHandle(this->file);
+#else
+	if (this->fd >= 0)
+		close(this->fd);
+#endif
+}
+
+bool MappedFileSource::is_open() const{
+#ifdef _WIN32
+	return this->file != INVALID_HANDLE_VALUE;
+#else
+	return this->fd >= 0;
+#endif
+}
+
+bool MappedFileSource::refill(size_t n){
+	return this->map(this->tell(), n);
+}
+
+bool MappedFileSource::seek(uint64_t position){
+	if (MemorySource::seek(position))
+		return true;
+	// Mapping at least a byte keeps map() from leaving an empty window in
+	// place at the end of the file.
+	return position < this->file_size && this->map(position, 1);
+}
+
+bool MappedFileSource::map(uint64_t position, size_t n){
+	// n may be a length read from the file, so position + n can overflow.
+	if (n > this->file_size || position > this->file_size - n)
+		return false;
+	static const uint64_t granularity = get_mapping_granularity();
+	uint64_t offset = position - position % granularity;
+	size_t delta = (size_t)(position - offset);
+	size_t length = std::max(this->window_size, delta + n);
+	if (length > this->file_size - offset)
+		length = (size_t)(this->file_size - offset);
+	if (!length)
+		return !n;
+	this->unmap();
+#ifdef _WIN32
+	if (!this->mapping)
+		return false;
+	this->window = MapViewOfFile(this->mapping, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)offset, length);
+	if (!this->window)
+		return false;
+#else
+	this->window = mmap(nullptr, length, PROT_READ, MAP_SHARED, this->fd, (off_t)offset);
+	if (this->window == MAP_FAILED){
+		this->window = nullptr;
+		return false;
+	}
+	madvise(this->window, length, MADV_SEQUENTIAL);
+	madvise(this->window, length, MADV_WILLNEED);
+#endif
+	this->window_length = length;
+	this->origin = offset;
+	this->begin = (const uint8_t *)this->window;
+	this->cursor = this->begin + delta;
+	this->end = this->begin + length;
+	return true;
+}
+
+void MappedFileSource::unmap(){
+	if (!this->window)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(this->window);
+#else
+	munmap(this->window, this->window_length);
+#endif
+	this->window = nullptr;
+	this->window_length = 0;
+	this->origin = this->tell();
+	this->begin = this->cursor = this->end = nullptr;
+}
+
+//-----------------------------------------------------------------------------
+
+BufferedStreamSource::BufferedStreamSource(std::istream &stream, size_t buffer_size): stream(stream), buffer(buffer_size){
+	this->begin = this->cursor = this->end = this->buffer.data();
+}
+
+bool BufferedStreamSource::refill(size_t n){
+	size_t remaining = this->available();
+	size_t offset = this->cursor - this->buffer.data();
+	this->origin = this->tell();
+	memmove(this->buffer.data(), this->buffer.data() + offset, remaining);
+	// The buffer only grows once the data fill it, so that a corrupt length
+	// runs into EOF before it can cause a huge allocation.
+	while (remaining < n){
+		if (remaining == this->buffer.size())
+			this->buffer.resize(std::max(this->buffer.size() * 2, default_buffer_size));
+		this->stream.read((char *)this->buffer.data() + remaining, this->buffer.size() - remaining);
+		auto read = (size_t)this->stream.gcount();
+		if (!read)
+			break;
+		remaining += read;
+	}
+	this->begin = this->cursor = this->buffer.data();
+	this->end = this->begin + remaining;
+	return remaining >= n;
+}
+
+//-----------------------------------------------------------------------------
+
+static const uint8_t index_signature[4] = { 'X', 'B', 'I', 'X' };
+static const size_t index_header_size = 24;
+
+bool RecordIndex::save(std::ostream &stream) const{
+	std::vector<uint8_t> buffer(index_header_size);
+	auto p = buffer.data();
+	memcpy(p, index_signature, sizeof(index_signature));
+	p = write_little_integer<uint32_t, 4, correct_sign_twoscomp>(p + sizeof(index_signature), this->interval);
+	p = write_little_integer<uint64_t, 8, correct_sign_twoscomp>(p, this->count);
+	write_little_integer<uint64_t, 8, correct_sign_twoscomp>(p, this->samples.size());
+	uint64_t last = 0;
+	for (auto sample : this->samples){
+		auto delta = sample - last;
+		last = sample;
+		for (; delta >= 0x80; delta >>= 7)
+			buffer.push_back((uint8_t)delta | 0x80);
+		buffer.push_back((uint8_t)delta);
+	}
+	stream.write((const char *)buffer.data(), buffer.size());
+	return !!stream;
+}
+
+bool RecordIndex::load(std::istream &stream){
+	uint8_t header[index_header_size];
+	if (!read_bytes(stream, header, sizeof(header)) || memcmp(header, index_signature, sizeof(index_signature)))
+		return false;
+	auto interval = decode_integer<uint32_t, 4, false, correct_sign_twoscomp>(header + 4);
+	auto count = decode_integer<uint64_t, 8, false, correct_sign_twoscomp>(header + 8);
+	auto sample_count = decode_integer<uint64_t, 8, false, correct_sign_twoscomp>(header + 16);
+	if (!interval || sample_count != count / interval + !!(count % interval))
+		return false;
+	std::vector<uint64_t> samples;
+	BufferedStreamSource source(stream);
+	uint64_t last = 0;
+	while (samples.size() < sample_count){
+		uint64_t delta = 0;
+		for (unsigned shift = 0;; shift += 7){
+			if (shift >= 64 || !source.ensure(1))
+				return false;
+			auto byte = *source.consume(1);
+			delta |= (uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				break;
+		}
+		last += delta;
+		samples.push_back(last);
+	}
+	this->interval = interval;
+	this->count = count;
+	this->samples = std::move(samples);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+WorkerPool::WorkerPool(unsigned threads): stopping(0){
+	if (!threads)
+		threads = std::max(std::thread::hardware_concurrency(), 1U);
+	for (unsigned i = 0; i < threads; i++)
+		this->threads.push_back(std::thread(&WorkerPool::work, this));
+}
+
+WorkerPool::~WorkerPool(){
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = 1;
+	}
+	this->available.notify_all();
+	for (auto &thread : this->threads)
+		thread.join();
+}
+
+void WorkerPool::submit(std::function<void()> job){
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->jobs.push_back(std::move(job));
+	}
+	this->available.notify_one();
+}
+
+void WorkerPool::work(){
+	while (1){
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->available.wait(lock, [this](){ return this->stopping || this->jobs.size(); });
+			if (!this->jobs.size())
+				return;
+			job = std::move(this->jobs.front());
+			this->jobs.pop_front();
+		}
+		job();
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+#ifdef BIN_INSTRUMENT
+namespace{
+
+// The counters of one thread, indexed by site. They are created as the
+// thread reaches new sites.
+struct ProbeTable{
+	std::deque<ProbeCounters> counters;
+	ProbeTable();
+	~ProbeTable();
+};
+
+struct ProbeRegistry{
+	std::mutex mutex;
+	std::vector<const ProbeSite *> sites;
+	std::vector<ProbeTable *> tables;
+	// What the threads that have exited counted.
+	std::deque<ProbeCounters> retired;
+};
+
+ProbeRegistry &get_probe_registry(){
+	static ProbeRegistry ret;
+	return ret;
+}
+
+void add_counters(std::deque<ProbeCounters> &dst, const std::deque<ProbeCounters> &src){
+	while (dst.size() < src.size())
+		dst.emplace_back();
+	for (size_t i = 0; i < src.size(); i++)
+		dst[i].add_from(src[i]);
+}
+
+ProbeTable::ProbeTable(){
+	auto &registry = get_probe_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	registry.tables.push_back(this);
+}
+
+ProbeTable::~ProbeTable(){
+	auto &registry = get_probe_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	add_counters(registry.retired, this->counters);
+	registry.tables.erase(std::find(registry.tables.begin(), registry.tables.end(), this));
+}
+
+}
+
+ProbeSite::ProbeSite(const char *type, const char *field): type(type), field(field){
+	auto &registry = get_probe_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	this->id = registry.sites.size();
+	registry.sites.push_back(this);
+}
+
+ProbeCounters &ProbeSite::counters() const{
+	thread_local ProbeTable table;
+	if (BIN_UNLIKELY(this->id >= table.counters.size())){
+		// Reports walk the table, so it only grows under the lock.
+		auto &registry = get_probe_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		while (table.counters.size() <= this->id)
+			table.counters.emplace_back();
+	}
+	return table.counters[this->id];
+}
+
+std::vector<ProbeTotal> collect_probes(){
+	auto &registry = get_probe_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	std::deque<ProbeCounters> sum;
+	add_counters(sum, registry.retired);
+	for (auto table : registry.tables)
+		add_counters(sum, table->counters);
+	// A parser instantiated for several sources has a site per source.
+	std::map<std::pair<std::string, std::string>, ProbeTotal> totals;
+	for (size_t i = 0; i < sum.size(); i++){
+		auto site = registry.sites[i];
+		auto field = site->field ? site->field : "";
+		auto &total = totals[std::make_pair(std::string(site->type), std::string(field))];
+		total.type = site->type;
+		total.field = field;
+		total.reads += sum[i].reads.load(std::memory_order_relaxed);
+		total.bytes += sum[i].bytes.load(std::memory_order_relaxed);
+		total.ticks += sum[i].ticks.load(std::memory_order_relaxed);
+	}
+	std::vector<ProbeTotal> ret;
+	for (auto &total : totals)
+		if (total.second.reads)
+			ret.push_back(total.second);
+	return ret;
+}
+
+void write_probe_report(std::ostream &stream){
+	auto totals = collect_probes();
+	std::sort(totals.begin(), totals.end(), [](const ProbeTotal &a, const ProbeTotal &b){
+		if (a.field.empty() != b.field.empty())
+			return a.field.empty();
+		return a.ticks > b.ticks;
+	});
+	char line[256];
+	snprintf(line, sizeof(line), "%-24s %-24s %12s %14s %16s %10s %10s\n", "type", "field", "reads", "bytes", "ticks", "ticks/read", "bytes/read");
+	stream <<line;
+	for (auto &total : totals){
+		snprintf(
+			line,
+			sizeof(line),
+			"%-24s %-24s %12llu %14llu %16llu %10.1f %10.1f\n",
+			total.type.c_str(),
+			total.field.empty() ? "(record)" : total.field.c_str(),
+			(unsigned long long)total.reads,
+			(unsigned long long)total.bytes,
+			(unsigned long long)total.ticks,
+			(double)total.ticks / total.reads,
+			(double)total.bytes / total.reads
+		);
+		stream <<line;
+	}
+}
+#endif
@@ -25,152 +25,1753 @@ the following restrictions:
 
 */
 #include <exception>
+#include <new>
 #include <istream>
-#include <boost/type_traits.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <limits>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+#if __cplusplus >= 201703L || defined(_MSVC_LANG) && _MSVC_LANG >= 201703L
+#include <string_view>
+#define BIN_HAS_STRING_VIEW
+#if defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define BIN_HAS_PMR
+#endif
+#endif
+#endif
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#define BIN_HAS_COROUTINES
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#endif
+#endif
+
+static_assert((-1 & 3) == 3, "Xabin requires a two's complement host.");
+
+#if defined(_WIN32) || defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BIN_HOST_IS_BIG_ENDIAN false
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define BIN_HOST_IS_BIG_ENDIAN true
+#else
+#error Unable to determine the byte order of the host.
+#endif
+
+// Bulk decoders use the widest vector extension enabled at compile time.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BIN_VECTOR __m256i
+#define BIN_SIMD(op) _mm256_##op
+#define BIN_SIMD_SI(op) _mm256_##op##_si256
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86_FP) && _M_IX86_FP >= 2
+#include <emmintrin.h>
+#define BIN_VECTOR __m128i
+#define BIN_SIMD(op) _mm_##op
+#define BIN_SIMD_SI(op) _mm_##op##_si128
+#endif
 
-#define TWOS_COMPLEMENT 0
-#define ONES_COMPLEMENT 1
-#define SIGN_BIT 2
-#define EXCESS_K_BIASED 3
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define BIN_HAS_EXCEPTIONS
+#endif
 
-#define NEGATIVE_ARITHMETIC_SYSTEM TWOS_COMPLEMENT
+// Error branches are hinted as unlikely, and whatever builds an error is kept
+// out of line, so that the hot paths of the parsers stay compact.
+#if defined(__GNUC__) || defined(__clang__)
+#define BIN_LIKELY(...) __builtin_expect(!!(__VA_ARGS__), 1)
+#define BIN_UNLIKELY(...) __builtin_expect(!!(__VA_ARGS__), 0)
+#define BIN_COLD __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+#define BIN_LIKELY(...) (__VA_ARGS__)
+#define BIN_UNLIKELY(...) (__VA_ARGS__)
+#define BIN_COLD __declspec(noinline)
+#else
+#define BIN_LIKELY(...) (__VA_ARGS__)
+#define BIN_UNLIKELY(...) (__VA_ARGS__)
+#define BIN_COLD
+#endif
+
+// Marks the cases of generated push parsers that go on into the next one.
+#if __cplusplus >= 201703L || defined(_MSVC_LANG) && _MSVC_LANG >= 201703L
+#define BIN_FALLTHROUGH [[fallthrough]]
+#elif defined(__GNUC__) && __GNUC__ >= 7
+#define BIN_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define BIN_FALLTHROUGH
+#endif
 
 enum class ParserStatus{
 	SUCCESS,
 	UNEXPECTED_EOF,
 	REQUIREMENT_NOT_MET,
 	ALLOCATION_ERROR,
+	// Returned by push parsers when the chunk ran out mid-record.
+	INCOMPLETE,
 };
 
 class ParsingException : public std::exception{
 	ParserStatus status;
 public:
 	ParsingException(ParserStatus status): status(status){}
+	ParserStatus get_status() const{
+		return this->status;
+	}
+	const char *what() const noexcept override;
 };
 
+/*
+BIN_USE_EXCEPTIONS selects how the runtime and the generated parsers report
+errors, and it must have the same value wherever library.h is included,
+library.cpp included. If it's defined, errors are thrown as
+ParsingExceptions. Otherwise every function that can fail takes its result
+by reference and returns a ParserStatus, and the runtime never throws; it
+then builds without exception support, too.
+*/
+#ifndef BIN_USE_EXCEPTIONS
+#define BIN_FUNCTION_SIGNATURE(return_type, name, ...) ParserStatus name##_nothrow(return_type &dst, __VA_ARGS__)
+#define BIN_HURL_ERROR(x) return x
+#define BIN_RETURN(x) dst = std::move(x); return ParserStatus::SUCCESS
+#else
+#ifndef BIN_HAS_EXCEPTIONS
+#error BIN_USE_EXCEPTIONS requires exception support.
+#endif
+// Throws from a function of its own, so that callers only pay for a call.
+[[noreturn]] BIN_COLD void throw_parsing_exception(ParserStatus);
+#define BIN_FUNCTION_SIGNATURE(return_type, name, ...) return_type name(__VA_ARGS__)
+#define BIN_HURL_ERROR(x) throw_parsing_exception(x)
+#define BIN_RETURN(x) return x
+#endif
+
+/*
+ParseResult is what the generated parse() returns in nothrow mode: the
+status of the parse and the record, which is complete only if the status is
+SUCCESS.
+*/
 template <typename T>
-boost::enable_if<boost::is_unsigned<T>, T> correct_sign_twoscomp(boost::make_unsigned<T> x){
-	return (Dst)x;
+struct ParseResult{
+	ParserStatus status;
+	T value;
+	ParseResult(): status(ParserStatus::SUCCESS){}
+	// Forwards to the record's constructor, e.g. to pass an allocator.
+	template <typename Arg, typename = typename std::enable_if<!std::is_same<typename std::decay<Arg>::type, ParseResult>::value>::type>
+	explicit ParseResult(Arg &&arg): status(ParserStatus::SUCCESS), value(std::forward<Arg>(arg)){}
+	explicit operator bool() const{
+		return this->status == ParserStatus::SUCCESS;
+	}
+	T &operator*(){
+		return this->value;
+	}
+	const T &operator*() const{
+		return this->value;
+	}
+	T *operator->(){
+		return &this->value;
+	}
+	const T *operator->() const{
+		return &this->value;
+	}
+};
+
+// Runs f, which returns a ParserStatus, turning a failure to allocate into
+// ALLOCATION_ERROR.
+template <typename F>
+ParserStatus guard_allocation(F f) noexcept{
+#ifdef BIN_HAS_EXCEPTIONS
+	try{
+		return f();
+	}catch (std::bad_alloc &){
+		return ParserStatus::ALLOCATION_ERROR;
+	}
+#else
+	return f();
+#endif
 }
 
-template <typename T>
-boost::enable_if<boost::is_signed<T>, T> correct_sign_twoscomp(boost::make_unsigned<T> x){
-#if NEGATIVE_ARITHMETIC_SYSTEM == TWOS_COMPLEMENT
-	return (Dst)x;
-#elif NEGATIVE_ARITHMETIC_SYSTEM == TWOS_COMPLEMENT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == ONES_COMPLEMENT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == SIGN_BIT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == EXCESS_K_BIASED
-#error
+/*
+MemorySource is a cursor over a contiguous buffer that is already in memory.
+Generated types can be constructed from either an std::istream or a
+MemorySource. The latter decodes fields directly from the buffer and never
+copies them through a temporary.
+
+Sources that can't see all their input at once (see MappedFileSource and
+BufferedStreamSource) derive from this class and override refill(), which
+is only reached when ensure() finds the current window exhausted. A refill
+may move the window, so pointers obtained from a source remain valid only
+until the next call to ensure(). In particular, types with borrowed fields
+may only be read from sources that never refill, such as a MappedFileSource
+whose window covers the whole file.
+*/
+class MemorySource{
+protected:
+	const uint8_t *begin,
+		*cursor,
+		*end;
+	// Stream offset of begin.
+	uint64_t origin;
+	MemorySource(): begin(nullptr), cursor(nullptr), end(nullptr), origin(0){}
+	// Must make at least n bytes available starting from the cursor, or
+	// return false if the input doesn't have that many bytes left.
+	virtual bool refill(size_t){
+		return false;
+	}
+public:
+	MemorySource(const void *buffer, size_t length):
+		begin((const uint8_t *)buffer),
+		cursor((const uint8_t *)buffer),
+		end((const uint8_t *)buffer + length),
+		origin(0){}
+	virtual ~MemorySource(){}
+	size_t available() const{
+		return this->end - this->cursor;
+	}
+	bool ensure(size_t n){
+		return BIN_LIKELY(this->available() >= n) || this->refill(n);
+	}
+	// Only valid after a successful ensure(n).
+	const uint8_t *consume(size_t n){
+		auto ret = this->cursor;
+		this->cursor += n;
+		return ret;
+	}
+	const uint8_t *get() const{
+		return this->cursor;
+	}
+	uint64_t tell() const{
+		return this->origin + (this->cursor - this->begin);
+	}
+	// Moves the cursor to a position as returned by tell(). The base class
+	// can only move within the data it currently holds.
+	virtual bool seek(uint64_t position){
+		if (position < this->origin || position - this->origin > (uint64_t)(this->end - this->begin))
+			return false;
+		this->cursor = this->begin + (size_t)(position - this->origin);
+		return true;
+	}
+};
+
+/*
+MappedFileSource maps a file into memory a window at a time, so inputs
+larger than the address space (or than RAM) can be parsed without ever
+being copied through a stream buffer. When window_size is at least the size
+of the file, the whole file is mapped once and no refill ever happens.
+*/
+class MappedFileSource : public MemorySource{
+#ifdef _WIN32
+	void *file,
+		*mapping;
+#else
+	int fd;
 #endif
+	uint64_t file_size;
+	size_t window_size;
+	void *window;
+	size_t window_length;
+	bool map(uint64_t position, size_t n);
+	void unmap();
+	MappedFileSource(const MappedFileSource &) = delete;
+	MappedFileSource &operator=(const MappedFileSource &) = delete;
+protected:
+	bool refill(size_t n);
+public:
+	static const size_t default_window_size = sizeof(void *) < 8 ? (size_t)1 << 26 : (size_t)1 << 30;
+	MappedFileSource(const char *path, size_t window_size = default_window_size);
+	~MappedFileSource();
+	bool is_open() const;
+	uint64_t size() const{
+		return this->file_size;
+	}
+	bool seek(uint64_t position);
+};
+
+/*
+BufferedStreamSource serves reads from large blocks pulled from an
+std::istream, for inputs that can't be mapped, such as pipes. The fast path
+of every read is the inline bounds check in ensure(); the stream is only
+touched when the buffer runs out. The buffer grows if a single read needs
+more than it holds.
+Because it reads ahead, the underlying stream ends up positioned past the
+data that has been parsed. Keep using the same BufferedStreamSource for
+consecutive records.
+*/
+class BufferedStreamSource : public MemorySource{
+	std::istream &stream;
+	std::vector<uint8_t> buffer;
+	BufferedStreamSource(const BufferedStreamSource &) = delete;
+	BufferedStreamSource &operator=(const BufferedStreamSource &) = delete;
+protected:
+	bool refill(size_t n);
+public:
+	static const size_t default_buffer_size = (size_t)1 << 16;
+	BufferedStreamSource(std::istream &stream, size_t buffer_size = default_buffer_size);
+};
+
+template <unsigned N>
+struct UnsignedOfSize{};
+
+template <>
+struct UnsignedOfSize<1>{
+	typedef uint8_t type;
+};
+
+template <>
+struct UnsignedOfSize<2>{
+	typedef uint16_t type;
+};
+
+template <>
+struct UnsignedOfSize<4>{
+	typedef uint32_t type;
+};
+
+template <>
+struct UnsignedOfSize<8>{
+	typedef uint64_t type;
+};
+
+inline uint8_t byte_swap(uint8_t x){
+	return x;
 }
 
-template <typename T>
-boost::enable_if<boost::is_unsigned<T>, T> correct_sign_onescomp(boost::make_unsigned<T> x){
-	return (Dst)x;
+inline uint16_t byte_swap(uint16_t x){
+#ifdef _MSC_VER
+	return _byteswap_ushort(x);
+#else
+	return __builtin_bswap16(x);
+#endif
 }
 
-template <typename T>
-boost::enable_if<boost::is_signed<T>, T> correct_sign_onescomp(boost::make_unsigned<T> x){
-#if NEGATIVE_ARITHMETIC_SYSTEM == TWOS_COMPLEMENT
-	const auto mask = (T)1 << (sizeof(T) * 8 - 1);
-	if (!(x & mask))
-		return (Dst)x;
-	return (Dst)(x + 1);
-#elif NEGATIVE_ARITHMETIC_SYSTEM == TWOS_COMPLEMENT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == ONES_COMPLEMENT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == SIGN_BIT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == EXCESS_K_BIASED
-#error
+inline uint32_t byte_swap(uint32_t x){
+#ifdef _MSC_VER
+	return _byteswap_ulong(x);
+#else
+	return __builtin_bswap32(x);
 #endif
 }
 
-template <typename T>
-boost::enable_if<boost::is_unsigned<T>, T> correct_sign_signbit(boost::make_unsigned<T> x){
-	return (Dst)x;
+inline uint64_t byte_swap(uint64_t x){
+#ifdef _MSC_VER
+	return _byteswap_uint64(x);
+#else
+	return __builtin_bswap64(x);
+#endif
 }
 
+#ifdef BIN_VECTOR
+/*
+VectorLanes<N> implements, for lanes of N bytes, the handful of operations
+the bulk decoders need. Only SSE2/AVX2 shifts and shuffles are used, so no
+extension beyond the baseline one is required.
+*/
+template <unsigned N>
+struct VectorLanes{};
+
+template <>
+struct VectorLanes<1>{
+	static BIN_VECTOR swap(BIN_VECTOR x){
+		return x;
+	}
+	// All ones in every lane whose top bit is set.
+	static BIN_VECTOR negative(BIN_VECTOR x){
+		return BIN_SIMD(cmpgt_epi8)(BIN_SIMD_SI(setzero)(), x);
+	}
+	static BIN_VECTOR sub(BIN_VECTOR a, BIN_VECTOR b){
+		return BIN_SIMD(sub_epi8)(a, b);
+	}
+	static BIN_VECTOR top(){
+		return BIN_SIMD(set1_epi8)((char)0x80);
+	}
+};
+
+template <>
+struct VectorLanes<2>{
+	static BIN_VECTOR swap(BIN_VECTOR x){
+		return BIN_SIMD_SI(or)(BIN_SIMD(slli_epi16)(x, 8), BIN_SIMD(srli_epi16)(x, 8));
+	}
+	static BIN_VECTOR negative(BIN_VECTOR x){
+		return BIN_SIMD(srai_epi16)(x, 15);
+	}
+	static BIN_VECTOR sub(BIN_VECTOR a, BIN_VECTOR b){
+		return BIN_SIMD(sub_epi16)(a, b);
+	}
+	static BIN_VECTOR top(){
+		return BIN_SIMD(set1_epi16)((short)0x8000);
+	}
+};
+
+template <>
+struct VectorLanes<4>{
+	static BIN_VECTOR swap(BIN_VECTOR x){
+		x = VectorLanes<2>::swap(x);
+		return BIN_SIMD_SI(or)(BIN_SIMD(slli_epi32)(x, 16), BIN_SIMD(srli_epi32)(x, 16));
+	}
+	static BIN_VECTOR negative(BIN_VECTOR x){
+		return BIN_SIMD(srai_epi32)(x, 31);
+	}
+	static BIN_VECTOR sub(BIN_VECTOR a, BIN_VECTOR b){
+		return BIN_SIMD(sub_epi32)(a, b);
+	}
+	static BIN_VECTOR top(){
+		return BIN_SIMD(set1_epi32)((int)0x80000000);
+	}
+};
+
+template <>
+struct VectorLanes<8>{
+	static BIN_VECTOR swap(BIN_VECTOR x){
+		return BIN_SIMD(shuffle_epi32)(VectorLanes<4>::swap(x), _MM_SHUFFLE(2, 3, 0, 1));
+	}
+	static BIN_VECTOR negative(BIN_VECTOR x){
+		return BIN_SIMD(shuffle_epi32)(BIN_SIMD(srai_epi32)(x, 31), _MM_SHUFFLE(3, 3, 1, 1));
+	}
+	static BIN_VECTOR sub(BIN_VECTOR a, BIN_VECTOR b){
+		return BIN_SIMD(sub_epi64)(a, b);
+	}
+	static BIN_VECTOR top(){
+		return BIN_SIMD(set1_epi64x)((long long)0x8000000000000000ULL);
+	}
+};
+#endif
+
+/*
+The correct_sign_* templates convert the raw bits of an integer, as they
+appear on the wire, into the value they represent under each of the
+negative mappings. Unsigned types pass through untouched. All of them are
+branch-free, and apply_vector() does the same to every lane of a vector.
+encode() is the inverse of apply(), for the writers.
+*/
 template <typename T>
-boost::enable_if<boost::is_signed<T>, T> correct_sign_signbit(boost::make_unsigned<T> x){
-#if NEGATIVE_ARITHMETIC_SYSTEM == TWOS_COMPLEMENT
-	const auto mask = (T)1 << (sizeof(T) * 8 - 1);
-	if (!(x & mask))
-		return (Dst)x;
-	return -(Dst)(x & ~mask);
-#elif NEGATIVE_ARITHMETIC_SYSTEM == TWOS_COMPLEMENT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == ONES_COMPLEMENT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == SIGN_BIT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == EXCESS_K_BIASED
-#error
+struct correct_sign_twoscomp{
+	typedef typename std::make_unsigned<T>::type U;
+	static constexpr T apply(U x){
+		return (T)x;
+	}
+	static constexpr U encode(T x){
+		return (U)x;
+	}
+#ifdef BIN_VECTOR
+	template <typename L>
+	static BIN_VECTOR apply_vector(BIN_VECTOR x){
+		return x;
+	}
 #endif
-}
+};
 
 template <typename T>
-boost::enable_if<boost::is_unsigned<T>, T> correct_sign_excessk_biased(boost::make_unsigned<T> x){
-	return (Dst)x;
-}
+struct correct_sign_onescomp{
+	typedef typename std::make_unsigned<T>::type U;
+	static constexpr T apply(U x){
+		// Negative values are one less than their two's complement form.
+		return !std::is_signed<T>::value ? (T)x : (T)(U)(x + (x >> (sizeof(T) * 8 - 1)));
+	}
+	static constexpr U encode(T x){
+		return x >= 0 ? (U)x : (U)((U)x - 1);
+	}
+#ifdef BIN_VECTOR
+	template <typename L>
+	static BIN_VECTOR apply_vector(BIN_VECTOR x){
+		return !std::is_signed<T>::value ? x : L::sub(x, L::negative(x));
+	}
+#endif
+};
+
+template <typename T>
+struct correct_sign_signbit{
+	typedef typename std::make_unsigned<T>::type U;
+	static constexpr U mask = (U)((U)1 << (sizeof(T) * 8 - 1));
+	static constexpr T apply(U x){
+		return !std::is_signed<T>::value || !(x & mask) ? (T)x : (T)-(T)(U)(x & (U)~mask);
+	}
+	static constexpr U encode(T x){
+		return x >= 0 ? (U)x : (U)(mask | (U)((U)0 - (U)x));
+	}
+#ifdef BIN_VECTOR
+	template <typename L>
+	static BIN_VECTOR apply_vector(BIN_VECTOR x){
+		if (!std::is_signed<T>::value)
+			return x;
+		// (m ^ s) - s negates m in the lanes where s is all ones.
+		auto s = L::negative(x);
+		auto m = BIN_SIMD_SI(andnot)(L::top(), x);
+		return L::sub(BIN_SIMD_SI(xor)(m, s), s);
+	}
+#endif
+};
 
 template <typename T>
-boost::enable_if<boost::is_signed<T>, T> correct_sign_excessk_biased(boost::make_unsigned<T> x){
-#if NEGATIVE_ARITHMETIC_SYSTEM == TWOS_COMPLEMENT
-	const auto mask = (T)1 << (sizeof(T) * 8 - 1);
-	if (x >= mask)
-		return (Dst)(x - mask);
-	return (Dst)x - (Dst)(mask - 1) - 1;
-#elif NEGATIVE_ARITHMETIC_SYSTEM == TWOS_COMPLEMENT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == ONES_COMPLEMENT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == SIGN_BIT
-#error
-#elif NEGATIVE_ARITHMETIC_SYSTEM == EXCESS_K_BIASED
-#error
+struct correct_sign_excessk_biased{
+	typedef typename std::make_unsigned<T>::type U;
+	static constexpr U mask = (U)((U)1 << (sizeof(T) * 8 - 1));
+	static constexpr T apply(U x){
+		// x - 2^(n-1) wraps to the same bits as flipping the top bit.
+		return !std::is_signed<T>::value ? (T)x : (T)(U)(x ^ mask);
+	}
+	static constexpr U encode(T x){
+		return !std::is_signed<T>::value ? (U)x : (U)((U)x ^ mask);
+	}
+#ifdef BIN_VECTOR
+	template <typename L>
+	static BIN_VECTOR apply_vector(BIN_VECTOR x){
+		return !std::is_signed<T>::value ? x : BIN_SIMD_SI(xor)(x, L::top());
+	}
 #endif
+};
+
+// Decodes an integer of N bytes with a single unaligned load, swapping the
+// bytes only when the wire order differs from the host's.
+template <typename T, unsigned N, bool BigEndian, template <typename> class F>
+inline T decode_integer(const void *bytes){
+	static_assert(N == sizeof(T), "Integer width doesn't match its type.");
+	typename UnsignedOfSize<N>::type x;
+	memcpy(&x, bytes, N);
+	if (BigEndian != BIN_HOST_IS_BIG_ENDIAN)
+		x = byte_swap(x);
+	return F<T>::apply(x);
 }
 
-#ifndef BIN_USE_EXCEPTIONS
-#define BIN_FUNCTION_SIGNATURE(return_type, name, ...) ParserStatus name##_nothrow(return_type &dst, __VA_ARGS__)
-#define BIN_HURL_ERROR(x) return x
-#define BIN_RETURN(x) dst = x; return ParserStatus::SUCCESS
-#else
-#define FUNCTION_SIGNATURE(return_type, name, ...) return_type name(__VA_ARGS__)
-#define HURL_ERROR(x) throw ParsingException(x)
-#define BIN_RETURN(x) return x
+// Decodes count consecutive integers of N bytes each. dst may alias src.
+template <typename T, unsigned N, bool BigEndian, template <typename> class F>
+void decode_integer_array(T *dst, const void *src, size_t count){
+	auto bytes = (const uint8_t *)src;
+	size_t i = 0;
+#ifdef BIN_VECTOR
+	typedef VectorLanes<N> L;
+	const size_t lanes = sizeof(BIN_VECTOR) / N;
+	for (; i + lanes <= count; i += lanes){
+		auto x = BIN_SIMD_SI(loadu)((const BIN_VECTOR *)(bytes + i * N));
+		if (BigEndian != BIN_HOST_IS_BIG_ENDIAN)
+			x = L::swap(x);
+		BIN_SIMD_SI(storeu)((BIN_VECTOR *)(dst + i), F<T>::template apply_vector<L>(x));
+	}
 #endif
+	for (; i != count; i++)
+		dst[i] = decode_integer<T, N, BigEndian, F>(bytes + i * N);
+}
+
+template <typename T, unsigned N, bool BigEndian, template <typename> class F>
+inline void encode_integer(void *bytes, T x){
+	static_assert(N == sizeof(T), "Integer width doesn't match its type.");
+	typename UnsignedOfSize<N>::type u = F<T>::encode(x);
+	if (BigEndian != BIN_HOST_IS_BIG_ENDIAN)
+		u = byte_swap(u);
+	memcpy(bytes, &u, N);
+}
 
-template <typename T, unsigned N, T F(std::make_unsigned<T>)>
+template <typename T, unsigned N, template <typename> class F>
 BIN_FUNCTION_SIGNATURE(T, read_little_integer, std::istream &stream){
 	unsigned char bytes[N];
 	stream.read((char *)bytes, N);
-	if (stream.gcount() < N)
+	if (BIN_UNLIKELY(stream.gcount() < N))
 		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
-	typedef boost::make_unsigned<T> u;
-	u temp = 0;
-	for (int i = 0; i != N; i++){
-		temp <<= 8;
-		temp |= bytes[i];
-	}
-	BIN_RETURN(F(temp));
+	BIN_RETURN((decode_integer<T, N, false, F>(bytes)));
 }
 
-BIN_FUNCTION_SIGNATURE(std::string, read_sized_string, size_t length, std::istream &stream);
+template <typename T, unsigned N, template <typename> class F>
+BIN_FUNCTION_SIGNATURE(T, read_big_integer, std::istream &stream){
+	unsigned char bytes[N];
+	stream.read((char *)bytes, N);
+	if (BIN_UNLIKELY(stream.gcount() < N))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN((decode_integer<T, N, true, F>(bytes)));
+}
+
+template <typename T, unsigned N, template <typename> class F>
+inline BIN_FUNCTION_SIGNATURE(T, read_little_integer, MemorySource &stream){
+	if (BIN_UNLIKELY(!stream.ensure(N)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN((decode_integer<T, N, false, F>(stream.consume(N))));
+}
+
+template <typename T, unsigned N, template <typename> class F>
+inline BIN_FUNCTION_SIGNATURE(T, read_big_integer, MemorySource &stream){
+	if (BIN_UNLIKELY(!stream.ensure(N)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN((decode_integer<T, N, true, F>(stream.consume(N))));
+}
+
+BIN_FUNCTION_SIGNATURE(std::string, read_sized_string, std::istream &stream, size_t length);
 BIN_FUNCTION_SIGNATURE(std::string, read_cstyle_string, std::istream &stream);
 BIN_FUNCTION_SIGNATURE(std::string, read_user_length_string, std::istream &stream);
 
-template <typename T>
-ParserStatus read_cstyle_array(std::vector<std::string> &dst, std::istream &stream){
+inline BIN_FUNCTION_SIGNATURE(std::string, read_sized_string, MemorySource &stream, size_t length){
+	if (BIN_UNLIKELY(!stream.ensure(length)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN(std::string((const char *)stream.consume(length), length));
+}
+
+// Returns the length of the run before the next NUL, without consuming it,
+// or -1 if the input ends first.
+inline ptrdiff_t find_terminator(MemorySource &stream){
+	size_t searched = 0;
+	const uint8_t *terminator;
+	while (!(terminator = (const uint8_t *)memchr(stream.get() + searched, 0, stream.available() - searched))){
+		searched = stream.available();
+		if (!stream.ensure(searched + 1))
+			return -1;
+	}
+	return terminator - stream.get();
+}
+
+inline BIN_FUNCTION_SIGNATURE(std::string, read_cstyle_string, MemorySource &stream){
+	auto length = find_terminator(stream);
+	if (BIN_UNLIKELY(length < 0))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	auto start = stream.consume(length + 1);
+	BIN_RETURN(std::string((const char *)start, length));
+}
+
+inline bool read_bytes(std::istream &stream, void *dst, size_t n){
+	stream.read((char *)dst, n);
+	return (size_t)stream.gcount() == n;
+}
+
+inline bool read_bytes(MemorySource &stream, void *dst, size_t n){
+	if (!stream.ensure(n))
+		return false;
+	memcpy(dst, stream.consume(n), n);
+	return true;
+}
+
+// Returns the next n bytes of the input and consumes them, or returns null
+// without consuming anything if they can't be had at once. MemorySources
+// return a pointer into their buffer. Streams copy into buffer, but only
+// bytes already available without blocking.
+inline const uint8_t *take_run(MemorySource &stream, uint8_t *, size_t n){
+	if (BIN_UNLIKELY(!stream.ensure(n)))
+		return nullptr;
+	return stream.consume(n);
+}
+
+inline const uint8_t *take_run(std::istream &stream, uint8_t *buffer, size_t n){
+	if (stream.rdbuf()->in_avail() < (std::streamsize)n || !read_bytes(stream, buffer, n))
+		return nullptr;
+	return buffer;
+}
+
+/*
+The assign_*_string() functions read into an existing string, so its
+allocator is kept. They return false if the input ends first.
+*/
+template <typename String>
+bool assign_sized_string(String &dst, MemorySource &stream, size_t length){
+	if (BIN_UNLIKELY(!stream.ensure(length)))
+		return false;
+	dst.assign((const char *)stream.consume(length), length);
+	return true;
+}
+
+// Grows dst a chunk at a time so that a corrupt length runs into EOF before
+// it can cause a huge allocation.
+template <typename String>
+bool assign_sized_string(String &dst, std::istream &stream, size_t length){
+	const size_t min_chunk = (size_t)1 << 16;
+	dst.clear();
+	while (length){
+		auto offset = dst.size();
+		size_t n = std::min(length, std::max(min_chunk, offset));
+		dst.resize(offset + n);
+		if (!read_bytes(stream, &dst[offset], n))
+			return false;
+		length -= n;
+	}
+	return true;
+}
+
+template <typename String>
+bool assign_cstyle_string(String &dst, MemorySource &stream){
+	auto length = find_terminator(stream);
+	if (BIN_UNLIKELY(length < 0))
+		return false;
+	auto start = stream.consume(length + 1);
+	dst.assign((const char *)start, length);
+	return true;
+}
+
+/*
+std::getline() scans the stream's buffered window for the terminator
+(with memchr, in the usual implementations) and appends the whole run at
+once, refilling the buffer only when the terminator isn't in it. Reaching
+the end of the input before the terminator leaves eofbit set.
+*/
+template <typename String>
+bool assign_cstyle_string(String &dst, std::istream &stream){
+	return std::getline(stream, dst, '\0') && !stream.eof();
+}
+
+#ifdef BIN_HAS_STRING_VIEW
+/*
+Borrowed fields point into the source's buffer instead of owning a copy,
+so they are only valid for as long as the buffer is. Strings become
+std::string_views and u8 arrays become ByteViews.
+*/
+class ByteView{
+	const uint8_t *pointer;
+	size_t length;
+public:
+	ByteView(): pointer(nullptr), length(0){}
+	ByteView(const uint8_t *pointer, size_t length): pointer(pointer), length(length){}
+	const uint8_t *data() const{
+		return this->pointer;
+	}
+	size_t size() const{
+		return this->length;
+	}
+	bool empty() const{
+		return !this->length;
+	}
+	const uint8_t *begin() const{
+		return this->pointer;
+	}
+	const uint8_t *end() const{
+		return this->pointer + this->length;
+	}
+	uint8_t operator[](size_t i) const{
+		return this->pointer[i];
+	}
+};
+
+inline BIN_FUNCTION_SIGNATURE(std::string_view, read_sized_string_view, MemorySource &stream, size_t length){
+	if (BIN_UNLIKELY(!stream.ensure(length)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN(std::string_view((const char *)stream.consume(length), length));
+}
+
+inline BIN_FUNCTION_SIGNATURE(std::string_view, read_cstyle_string_view, MemorySource &stream){
+	auto length = find_terminator(stream);
+	if (BIN_UNLIKELY(length < 0))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	auto start = stream.consume(length + 1);
+	BIN_RETURN(std::string_view((const char *)start, length));
+}
+
+inline BIN_FUNCTION_SIGNATURE(ByteView, read_sized_byte_view, MemorySource &stream, size_t length){
+	if (BIN_UNLIKELY(!stream.ensure(length)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN(ByteView(stream.consume(length), length));
+}
+
+inline BIN_FUNCTION_SIGNATURE(ByteView, read_cstyle_byte_view, MemorySource &stream){
+	auto length = find_terminator(stream);
+	if (BIN_UNLIKELY(length < 0))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	auto start = stream.consume(length + 1);
+	BIN_RETURN(ByteView(start, length));
+}
+#endif
+
+/*
+The array readers grow dst a chunk at a time and decode each chunk in bulk,
+so a corrupt length fails with UNEXPECTED_EOF instead of trying to allocate
+whatever the length claims.
+*/
+template <typename T, unsigned N, bool BigEndian, template <typename> class F, typename Vector>
+bool read_integer_array(Vector &dst, std::istream &stream, size_t count){
+	const size_t min_chunk = ((size_t)1 << 16) / N;
+	dst.clear();
+	while (count){
+		auto offset = dst.size();
+		size_t n = std::min(count, std::max(min_chunk, offset));
+		dst.resize(offset + n);
+		auto p = &dst[offset];
+		if (!read_bytes(stream, p, n * N))
+			return false;
+		decode_integer_array<T, N, BigEndian, F>(p, p, n);
+		count -= n;
+	}
+	return true;
+}
 
+template <typename T, unsigned N, bool BigEndian, template <typename> class F, typename Vector>
+bool read_integer_array(Vector &dst, MemorySource &stream, size_t count){
+	dst.clear();
+	while (count){
+		if (!stream.ensure(N))
+			return false;
+		size_t n = std::min(count, stream.available() / N);
+		auto offset = dst.size();
+		dst.resize(offset + n);
+		decode_integer_array<T, N, BigEndian, F>(&dst[offset], stream.consume(n * N), n);
+		count -= n;
+	}
+	return true;
+}
+
+// C-style arrays end at the first element whose value is zero.
+template <typename T, unsigned N, bool BigEndian, template <typename> class F, typename Vector, typename Source>
+bool read_terminated_integer_array(Vector &dst, Source &stream){
+	dst.clear();
+	while (1){
+		unsigned char bytes[N];
+		if (!read_bytes(stream, bytes, N))
+			return false;
+		auto x = decode_integer<T, N, BigEndian, F>(bytes);
+		if (!x)
+			break;
+		dst.push_back(x);
+	}
+	return true;
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Source>
+BIN_FUNCTION_SIGNATURE(std::vector<T>, read_little_sized_array, Source &stream, size_t count){
+	std::vector<T> ret;
+	if (BIN_UNLIKELY(!read_integer_array<T, N, false, F>(ret, stream, count)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN(ret);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Source>
+BIN_FUNCTION_SIGNATURE(std::vector<T>, read_big_sized_array, Source &stream, size_t count){
+	std::vector<T> ret;
+	if (BIN_UNLIKELY(!read_integer_array<T, N, true, F>(ret, stream, count)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN(ret);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Source>
+BIN_FUNCTION_SIGNATURE(std::vector<T>, read_little_cstyle_array, Source &stream){
+	std::vector<T> ret;
+	if (BIN_UNLIKELY(!read_terminated_integer_array<T, N, false, F>(ret, stream)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN(ret);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Source>
+BIN_FUNCTION_SIGNATURE(std::vector<T>, read_big_cstyle_array, Source &stream){
+	std::vector<T> ret;
+	if (BIN_UNLIKELY(!read_terminated_integer_array<T, N, true, F>(ret, stream)))
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	BIN_RETURN(ret);
+}
+
+// The skippers advance a source past a datum without decoding it, and
+// return false if the input ends first.
+inline bool skip_bytes(MemorySource &stream, size_t n){
+	if (!stream.ensure(n))
+		return false;
+	stream.consume(n);
+	return true;
+}
+
+inline bool skip_cstyle_string(MemorySource &stream){
+	auto length = find_terminator(stream);
+	if (length < 0)
+		return false;
+	stream.consume(length + 1);
+	return true;
+}
+
+inline bool skip_bytes(std::istream &stream, size_t n){
+	stream.ignore((std::streamsize)n);
+	return (size_t)stream.gcount() == n;
+}
+
+inline bool skip_cstyle_string(std::istream &stream){
+	stream.ignore(std::numeric_limits<std::streamsize>::max(), '\0');
+	return !stream.eof();
+}
+
+// Skips an integer that later data depend on, decoding it into dst.
+template <typename T, unsigned N, template <typename> class F>
+bool skip_little_integer(MemorySource &stream, T &dst){
+	if (!stream.ensure(N))
+		return false;
+	dst = decode_integer<T, N, false, F>(stream.consume(N));
+	return true;
+}
+
+template <typename T, unsigned N, template <typename> class F>
+bool skip_big_integer(MemorySource &stream, T &dst){
+	if (!stream.ensure(N))
+		return false;
+	dst = decode_integer<T, N, true, F>(stream.consume(N));
+	return true;
+}
+
+template <typename T, unsigned N, template <typename> class F>
+bool skip_little_integer(std::istream &stream, T &dst){
+	uint8_t bytes[N];
+	if (!read_bytes(stream, bytes, N))
+		return false;
+	dst = decode_integer<T, N, false, F>(bytes);
+	return true;
+}
+
+template <typename T, unsigned N, template <typename> class F>
+bool skip_big_integer(std::istream &stream, T &dst){
+	uint8_t bytes[N];
+	if (!read_bytes(stream, bytes, N))
+		return false;
+	dst = decode_integer<T, N, true, F>(bytes);
+	return true;
+}
+
+template <typename T, unsigned N, bool BigEndian, template <typename> class F>
+bool skip_terminated_integer_array(MemorySource &stream){
+	while (1){
+		if (!stream.ensure(N))
+			return false;
+		if (!decode_integer<T, N, BigEndian, F>(stream.consume(N)))
+			return true;
+	}
+}
+
+template <typename T, unsigned N, bool BigEndian, template <typename> class F>
+bool skip_terminated_integer_array(std::istream &stream){
+	while (1){
+		uint8_t bytes[N];
+		if (!read_bytes(stream, bytes, N))
+			return false;
+		if (!decode_integer<T, N, BigEndian, F>(bytes))
+			return true;
+	}
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Source>
+bool skip_little_cstyle_array(Source &stream){
+	return skip_terminated_integer_array<T, N, false, F>(stream);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Source>
+bool skip_big_cstyle_array(Source &stream){
+	return skip_terminated_integer_array<T, N, true, F>(stream);
+}
+
+/*
+Types whose encoded layout matches the host's have a packed Wire struct.
+Arrays of them are read with a single copy, or used in place if the source
+is in memory, in which case they're only valid until the next refill. The
+requirements of the type are then checked over every record. read_records()
+leaves the records it copied in dst even if one of them fails, while
+map_records() only consumes the records if all of them pass.
+*/
+template <typename Wire>
+bool check_records(const Wire *records, size_t count){
+	for (size_t i = 0; i < count; i++)
+		if (BIN_UNLIKELY(!records[i].valid()))
+			return 0;
+	return 1;
+}
+
+template <typename Wire, typename Source>
+ParserStatus read_records(Source &stream, Wire *dst, size_t count){
+	if (count > std::numeric_limits<size_t>::max() / sizeof(Wire) || !read_bytes(stream, dst, count * sizeof(Wire)))
+		return ParserStatus::UNEXPECTED_EOF;
+	if (!check_records(dst, count))
+		return ParserStatus::REQUIREMENT_NOT_MET;
+	return ParserStatus::SUCCESS;
+}
+
+template <typename Wire>
+ParserStatus map_records(MemorySource &stream, const Wire *&dst, size_t count){
+	dst = nullptr;
+	if (count > std::numeric_limits<size_t>::max() / sizeof(Wire) || !stream.ensure(count * sizeof(Wire)))
+		return ParserStatus::UNEXPECTED_EOF;
+	auto records = (const Wire *)stream.get();
+	if (!check_records(records, count))
+		return ParserStatus::REQUIREMENT_NOT_MET;
+	dst = (const Wire *)stream.consume(count * sizeof(Wire));
+	return ParserStatus::SUCCESS;
+}
+
+/*
+RecordView is the base of the generated view classes. A view wraps the bytes
+of a single record and only decodes a field when its accessor is called.
+Fields at a constant offset from the start of the record are decoded
+directly; the offsets of the fields that follow a variable-length datum are
+found by a single pass over the record the first time any of them is
+needed. Views don't check requirements, and the lazily built offset table
+makes a view unsafe to share between threads.
+*/
+class RecordView{
+protected:
+	const uint8_t *data;
+	size_t size;
+	// Returns a source positioned offset bytes into the record, or at its end
+	// if the record is shorter than that.
+	MemorySource at(size_t offset) const{
+		MemorySource ret(this->data, this->size);
+		ret.consume(std::min(offset, this->size));
+		return ret;
+	}
+public:
+	RecordView(const void *data, size_t size): data((const uint8_t *)data), size(size){}
+};
+
+/*
+RecordIndex holds the offsets at which every interval-th record of an input
+starts, so that record i can be reached by seeking to the closest sample
+before it and skipping the rest of the way with the generated T::skip().
+Building an index takes a single pass that skips records instead of
+decoding them. On disk the samples are stored as LEB128-encoded deltas
+after a short header.
+*/
+class RecordIndex{
+	unsigned interval;
+	uint64_t count;
+	std::vector<uint64_t> samples;
+public:
+	static const unsigned default_interval = 64;
+	RecordIndex(unsigned interval = default_interval): interval(interval ? interval : 1), count(0){}
+	// Number of records indexed.
+	uint64_t size() const{
+		return this->count;
+	}
+	unsigned get_interval() const{
+		return this->interval;
+	}
+	// Indexes records of type T from the current position to the end of the
+	// source. Returns false if the input ends in the middle of a record.
+	template <typename T>
+	bool build(MemorySource &source){
+		return this->build(source, T::template skip<MemorySource>);
+	}
+	// Same, with records skipped by skip(source) instead of T::skip(), such
+	// as the ones of a BytecodeProgram.
+	template <typename Skip>
+	bool build(MemorySource &source, Skip skip);
+	// Positions the source at the start of record i.
+	template <typename T>
+	bool seek(MemorySource &source, uint64_t i) const{
+		return this->seek(source, i, T::template skip<MemorySource>);
+	}
+	template <typename Skip>
+	bool seek(MemorySource &source, uint64_t i, Skip skip) const;
+	bool save(std::ostream &) const;
+	bool load(std::istream &);
+};
+
+template <typename Skip>
+bool RecordIndex::build(MemorySource &source, Skip skip){
+	this->count = 0;
+	this->samples.clear();
+	while (source.ensure(1)){
+		auto position = source.tell();
+		if (this->count % this->interval == 0)
+			this->samples.push_back(position);
+		// A record that doesn't move the source forward would never reach
+		// the end.
+		if (!skip(source) || source.tell() <= position)
+			return false;
+		this->count++;
+	}
+	return true;
+}
+
+template <typename Skip>
+bool RecordIndex::seek(MemorySource &source, uint64_t i, Skip skip) const{
+	if (i >= this->count || !source.seek(this->samples[(size_t)(i / this->interval)]))
+		return false;
+	for (auto n = i % this->interval; n; n--){
+		auto position = source.tell();
+		if (!skip(source) || source.tell() <= position)
+			return false;
+	}
+	return true;
+}
+
+/*
+PushState holds the progress of a push parser through a record, so that
+the generated push() can return as soon as a chunk runs out and resume
+exactly where it left off when the next chunk arrives. Only the bytes of a
+fixed-size value that straddles two chunks are ever copied into partial;
+strings and arrays are appended to their destinations as they arrive.
+When a requirement isn't met, push() resets the state, so that the next
+call starts on a new record.
+*/
+class PushState{
+public:
+	// Index of the datum being read.
+	unsigned field;
+	// Whether the destination of the current datum has been cleared yet.
+	bool started;
+	std::vector<uint8_t> partial;
+	PushState(): field(0), started(0){}
+	void next(){
+		this->field++;
+		this->started = 0;
+		this->partial.clear();
+	}
+	void reset(){
+		this->field = 0;
+		this->started = 0;
+		this->partial.clear();
+	}
+	// Makes n contiguous bytes available in p, either directly from the chunk
+	// or from partial. Returns false if the chunk ran out first.
+	bool gather(MemorySource &chunk, size_t n, const uint8_t *&p){
+		if (this->partial.empty() && chunk.ensure(n)){
+			p = chunk.consume(n);
+			return 1;
+		}
+		size_t take = std::min(n - this->partial.size(), chunk.available());
+		auto q = chunk.consume(take);
+		this->partial.insert(this->partial.end(), q, q + take);
+		if (this->partial.size() < n)
+			return 0;
+		p = this->partial.data();
+		return 1;
+	}
+	// Clears dst the first time the current datum is visited.
+	template <typename T>
+	void start(T &dst){
+		if (this->started)
+			return;
+		dst.clear();
+		this->started = 1;
+	}
+};
+
+template <typename T, unsigned N, bool BigEndian, template <typename> class F>
+bool push_integer(T &dst, MemorySource &chunk, PushState &state){
+	const uint8_t *p;
+	if (!state.gather(chunk, N, p))
+		return 0;
+	dst = decode_integer<T, N, BigEndian, F>(p);
+	return 1;
+}
+
+template <typename T, unsigned N, template <typename> class F>
+bool push_little_integer(T &dst, MemorySource &chunk, PushState &state){
+	return push_integer<T, N, false, F>(dst, chunk, state);
+}
+
+template <typename T, unsigned N, template <typename> class F>
+bool push_big_integer(T &dst, MemorySource &chunk, PushState &state){
+	return push_integer<T, N, true, F>(dst, chunk, state);
+}
+
+template <typename String>
+bool push_sized_string(String &dst, MemorySource &chunk, PushState &state, size_t length){
+	state.start(dst);
+	size_t n = std::min(length - dst.size(), chunk.available());
+	dst.append((const char *)chunk.consume(n), n);
+	return dst.size() == length;
+}
+
+template <typename String>
+bool push_cstyle_string(String &dst, MemorySource &chunk, PushState &state){
+	state.start(dst);
+	auto start = chunk.get();
+	auto terminator = (const uint8_t *)memchr(start, 0, chunk.available());
+	if (!terminator){
+		size_t n = chunk.available();
+		dst.append((const char *)chunk.consume(n), n);
+		return 0;
+	}
+	size_t length = terminator - start;
+	dst.append((const char *)chunk.consume(length + 1), length);
+	return 1;
+}
+
+template <typename T, unsigned N, bool BigEndian, template <typename> class F, typename Vector>
+bool push_integer_array(Vector &dst, MemorySource &chunk, PushState &state, size_t count){
+	state.start(dst);
+	while (dst.size() < count){
+		if (state.partial.size() || chunk.available() < N){
+			// An element straddles the chunk boundary.
+			T x;
+			if (!push_integer<T, N, BigEndian, F>(x, chunk, state))
+				return 0;
+			state.partial.clear();
+			dst.push_back(x);
+			continue;
+		}
+		size_t n = std::min(count - dst.size(), chunk.available() / N);
+		auto offset = dst.size();
+		dst.resize(offset + n);
+		decode_integer_array<T, N, BigEndian, F>(&dst[offset], chunk.consume(n * N), n);
+	}
+	return 1;
+}
+
+template <typename T, unsigned N, bool BigEndian, template <typename> class F, typename Vector>
+bool push_terminated_integer_array(Vector &dst, MemorySource &chunk, PushState &state){
+	state.start(dst);
+	while (1){
+		T x;
+		if (!push_integer<T, N, BigEndian, F>(x, chunk, state))
+			return 0;
+		state.partial.clear();
+		if (!x)
+			return 1;
+		dst.push_back(x);
+	}
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Vector>
+bool push_little_sized_array(Vector &dst, MemorySource &chunk, PushState &state, size_t count){
+	return push_integer_array<T, N, false, F>(dst, chunk, state, count);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Vector>
+bool push_big_sized_array(Vector &dst, MemorySource &chunk, PushState &state, size_t count){
+	return push_integer_array<T, N, true, F>(dst, chunk, state, count);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Vector>
+bool push_little_cstyle_array(Vector &dst, MemorySource &chunk, PushState &state){
+	return push_terminated_integer_array<T, N, false, F>(dst, chunk, state);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Vector>
+bool push_big_cstyle_array(Vector &dst, MemorySource &chunk, PushState &state){
+	return push_terminated_integer_array<T, N, true, F>(dst, chunk, state);
+}
+
+/*
+The writers encode into a caller-supplied buffer, which must be large
+enough for the value being written (the generated encoded_size() gives the
+size of a whole record), and return the end of what they wrote. Sized
+strings and arrays are truncated or zero-padded to the length stated in the
+record, so the output always agrees with its own length fields.
+*/
+template <typename T, unsigned N, template <typename> class F>
+uint8_t *write_little_integer(uint8_t *dst, T x){
+	encode_integer<T, N, false, F>(dst, x);
+	return dst + N;
+}
+
+template <typename T, unsigned N, template <typename> class F>
+uint8_t *write_big_integer(uint8_t *dst, T x){
+	encode_integer<T, N, true, F>(dst, x);
+	return dst + N;
+}
+
+template <typename String>
+uint8_t *write_sized_string(uint8_t *dst, const String &s, size_t length){
+	size_t n = std::min((size_t)s.size(), length);
+	memcpy(dst, s.data(), n);
+	memset(dst + n, 0, length - n);
+	return dst + length;
+}
+
+template <typename String>
+uint8_t *write_cstyle_string(uint8_t *dst, const String &s){
+	memcpy(dst, s.data(), s.size());
+	dst[s.size()] = 0;
+	return dst + s.size() + 1;
+}
+
+template <typename T, unsigned N, bool BigEndian, template <typename> class F, typename Vector>
+uint8_t *encode_integer_array(uint8_t *dst, const Vector &src, size_t count){
+	size_t n = std::min(src.size(), count);
+	for (size_t i = 0; i != n; i++)
+		encode_integer<T, N, BigEndian, F>(dst + i * N, src[i]);
+	memset(dst + n * N, 0, (count - n) * N);
+	return dst + count * N;
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Vector>
+uint8_t *write_little_sized_array(uint8_t *dst, const Vector &src, size_t count){
+	return encode_integer_array<T, N, false, F>(dst, src, count);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Vector>
+uint8_t *write_big_sized_array(uint8_t *dst, const Vector &src, size_t count){
+	return encode_integer_array<T, N, true, F>(dst, src, count);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Vector>
+uint8_t *write_little_cstyle_array(uint8_t *dst, const Vector &src){
+	dst = encode_integer_array<T, N, false, F>(dst, src, src.size());
+	return write_little_integer<T, N, F>(dst, 0);
+}
+
+template <typename T, unsigned N, template <typename> class F, typename Vector>
+uint8_t *write_big_cstyle_array(uint8_t *dst, const Vector &src){
+	dst = encode_integer_array<T, N, true, F>(dst, src, src.size());
+	return write_big_integer<T, N, F>(dst, 0);
 }
 
+#ifdef BIN_HAS_COROUTINES
+/*
+ParseTask is the coroutine type returned by the generated parse_async().
+The coroutine starts eagerly and runs until its source has to wait for
+input. It can be co_awaited from another coroutine, or polled with done()
+by whatever drives the sources (see AsyncReactor). The record and the
+source must outlive the task.
+*/
+class ParseTask{
+public:
+	struct promise_type;
+	typedef std::coroutine_handle<promise_type> handle_type;
+	struct FinalAwaiter{
+		bool await_ready() noexcept{
+			return 0;
+		}
+		std::coroutine_handle<> await_suspend(handle_type h) noexcept{
+			auto continuation = h.promise().continuation;
+			if (continuation)
+				return continuation;
+			return std::noop_coroutine();
+		}
+		void await_resume() noexcept{}
+	};
+	struct promise_type{
+		ParserStatus status;
+		std::exception_ptr exception;
+		std::coroutine_handle<> continuation;
+		promise_type(): status(ParserStatus::SUCCESS){}
+		ParseTask get_return_object(){
+			return ParseTask(handle_type::from_promise(*this));
+		}
+		std::suspend_never initial_suspend() noexcept{
+			return std::suspend_never();
+		}
+		FinalAwaiter final_suspend() noexcept{
+			return FinalAwaiter();
+		}
+		void return_value(ParserStatus status){
+			this->status = status;
+		}
+		void unhandled_exception(){
+			this->exception = std::current_exception();
+		}
+	};
+private:
+	handle_type handle;
+	ParseTask(handle_type handle): handle(handle){}
+	ParseTask(const ParseTask &) = delete;
+	ParseTask &operator=(const ParseTask &) = delete;
+public:
+	ParseTask(ParseTask &&other): handle(other.handle){
+		other.handle = nullptr;
+	}
+	~ParseTask(){
+		if (this->handle)
+			this->handle.destroy();
+	}
+	bool done() const{
+		return this->handle.done();
+	}
+	// Only valid once done() is true. Rethrows any exception thrown by the
+	// parser.
+	ParserStatus get() const{
+		auto &promise = this->handle.promise();
+		if (promise.exception)
+			std::rethrow_exception(promise.exception);
+		return promise.status;
+	}
+	bool await_ready() const{
+		return this->done();
+	}
+	void await_suspend(std::coroutine_handle<> continuation){
+		this->handle.promise().continuation = continuation;
+	}
+	ParserStatus await_resume() const{
+		return this->get();
+	}
+};
+
+#ifndef _WIN32
+class AsyncReactor;
+
+/*
+AsyncFdSource buffers input from a non-blocking file descriptor, such as a
+pipe or a socket. Parsers consume it like any other MemorySource, and
+co_await fill() when they run out of input, which suspends them in the
+reactor until the descriptor becomes readable. fill() yields false once the
+input has ended.
+*/
+class AsyncFdSource : public MemorySource{
+	AsyncReactor &reactor;
+	int fd;
+	bool ended;
+	std::vector<uint8_t> buffer;
+	AsyncFdSource(const AsyncFdSource &) = delete;
+	AsyncFdSource &operator=(const AsyncFdSource &) = delete;
+public:
+	// 1 if data was read, 0 if the input ended, -1 if the read would block.
+	int try_fill();
+	class FillAwaiter{
+		AsyncFdSource &source;
+		int result;
+	public:
+		FillAwaiter(AsyncFdSource &source): source(source), result(-1){}
+		bool await_ready(){
+			this->result = this->source.try_fill();
+			return this->result >= 0;
+		}
+		void await_suspend(std::coroutine_handle<> h);
+		bool await_resume(){
+			// A spurious wakeup reports success with no new data; the parser
+			// will simply ask again.
+			if (this->result < 0)
+				this->result = this->source.try_fill();
+			return this->result != 0;
+		}
+	};
+	AsyncFdSource(AsyncReactor &reactor, int fd, size_t buffer_size = (size_t)1 << 16);
+	FillAwaiter fill(){
+		return FillAwaiter(*this);
+	}
+	int get_fd() const{
+		return this->fd;
+	}
+};
+
+/*
+AsyncReactor is a single-threaded poll() loop that resumes the coroutines
+suspended on an AsyncFdSource as their descriptors become readable.
+*/
+class AsyncReactor{
+	std::vector<std::pair<int, std::coroutine_handle<> > > waiting;
+public:
+	void wait_readable(int fd, std::coroutine_handle<> h){
+		this->waiting.push_back(std::make_pair(fd, h));
+	}
+	// Runs until no coroutine is waiting for input.
+	void run();
+};
+
+inline void AsyncFdSource::FillAwaiter::await_suspend(std::coroutine_handle<> h){
+	this->source.reactor.wait_readable(this->source.fd, h);
+}
+
+inline AsyncFdSource::AsyncFdSource(AsyncReactor &reactor, int fd, size_t buffer_size):
+		reactor(reactor),
+		fd(fd),
+		ended(0),
+		buffer(buffer_size){
+	this->begin = this->cursor = this->end = this->buffer.data();
+}
+
+inline int AsyncFdSource::try_fill(){
+	if (this->ended)
+		return 0;
+	size_t remaining = this->available();
+	size_t offset = this->cursor - this->buffer.data();
+	auto data = this->buffer.data();
+	if (remaining == this->buffer.size())
+		return 1;
+	this->origin = this->tell();
+	memmove(data, data + offset, remaining);
+	this->begin = this->cursor = data;
+	this->end = data + remaining;
+	while (1){
+		auto n = read(this->fd, data + remaining, this->buffer.size() - remaining);
+		if (n > 0){
+			this->end += n;
+			return 1;
+		}
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return -1;
+		this->ended = 1;
+		return 0;
+	}
+}
+
+inline void AsyncReactor::run(){
+	std::vector<pollfd> fds;
+	std::vector<std::coroutine_handle<> > ready;
+	while (this->waiting.size()){
+		fds.resize(this->waiting.size());
+		for (size_t i = 0; i < fds.size(); i++){
+			fds[i].fd = this->waiting[i].first;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+		if (poll(fds.data(), fds.size(), -1) < 0){
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		// Resumed coroutines may start waiting again, so the ready ones are
+		// taken out of the list before any of them runs.
+		ready.clear();
+		size_t kept = 0;
+		for (size_t i = 0; i < fds.size(); i++){
+			if (fds[i].revents)
+				ready.push_back(this->waiting[i].second);
+			else
+				this->waiting[kept++] = this->waiting[i];
+		}
+		this->waiting.resize(kept);
+		for (auto h : ready)
+			h.resume();
+	}
+}
+#endif
+#endif
+
+/*
+WorkerPool is a fixed set of threads that run submitted jobs in the order
+they were submitted. The destructor waits for every job to finish.
+*/
+class WorkerPool{
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()> > jobs;
+	std::mutex mutex;
+	std::condition_variable available;
+	bool stopping;
+	void work();
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+public:
+	// 0 threads means one per hardware thread.
+	WorkerPool(unsigned threads = 0);
+	~WorkerPool();
+	size_t size() const{
+		return this->threads.size();
+	}
+	void submit(std::function<void()> job);
+};
+
+// A run of consecutive records, parsed by a worker.
+template <typename T>
+struct ParallelBatch{
+	MemorySource source;
+	size_t count;
+	std::vector<T> records;
+	ParserStatus status;
+	std::exception_ptr error;
+	bool done;
+	ParallelBatch(const uint8_t *begin, const uint8_t *end, size_t count):
+		source(begin, end - begin),
+		count(count),
+		status(ParserStatus::SUCCESS),
+		done(0){}
+	// Parses up to the first record that fails.
+	void parse(){
+		this->records.reserve(this->count);
+#ifdef BIN_USE_EXCEPTIONS
+		try{
+			while (this->records.size() < this->count)
+				this->records.emplace_back(this->source);
+		}catch (...){
+			this->error = std::current_exception();
+		}
+#else
+		while (this->records.size() < this->count){
+			auto result = T::parse(this->source);
+			if (!result){
+				this->status = result.status;
+				break;
+			}
+			this->records.push_back(std::move(result.value));
+		}
+#endif
+	}
+};
+
+// The batches in flight, in input order. Jobs refer to the queue, so it
+// waits for all of them before it's destroyed, however parse_parallel()
+// exits.
 template <typename T>
-ParserStatus read_cstyle_array(std::vector<T> &dst, std::istream &stream){
+class ParallelQueue{
+	std::deque<std::unique_ptr<ParallelBatch<T> > > batches;
+	std::mutex mutex;
+	std::condition_variable finished;
+	void wait_front(){
+		std::unique_lock<std::mutex> lock(this->mutex);
+		auto &batch = *this->batches.front();
+		this->finished.wait(lock, [&batch](){ return batch.done; });
+	}
+public:
+	~ParallelQueue(){
+		while (this->batches.size()){
+			this->wait_front();
+			this->batches.pop_front();
+		}
+	}
+	size_t size() const{
+		return this->batches.size();
+	}
+	void submit(WorkerPool &pool, std::unique_ptr<ParallelBatch<T> > batch){
+		auto p = batch.get();
+		this->batches.push_back(std::move(batch));
+		pool.submit([this, p](){
+			p->parse();
+			std::lock_guard<std::mutex> lock(this->mutex);
+			p->done = 1;
+			this->finished.notify_all();
+		});
+	}
+	// Waits for the oldest batch and removes it from the queue.
+	std::unique_ptr<ParallelBatch<T> > pop(){
+		this->wait_front();
+		auto ret = std::move(this->batches.front());
+		this->batches.pop_front();
+		return ret;
+	}
+};
+
+/*
+parse_parallel() parses a buffer holding consecutive records of type T on
+a worker pool. The calling thread frames the input with T::skip(), which
+only decodes the length fields, and hands out batches of batch_size
+records to the workers. It passes every record to callback, in input
+order, as an rvalue. At most two batches per worker are in flight at once,
+so memory use doesn't grow with the size of the input.
+Records before an error are still delivered. The error is then thrown, or
+returned in nothrow mode. It's UNEXPECTED_EOF if the buffer ends in the
+middle of a record.
+*/
+template <typename T, typename Callback>
+ParserStatus parse_parallel(WorkerPool &pool, const void *buffer, size_t length, Callback callback, size_t batch_size = 1024){
+	ParallelQueue<T> queue;
+	MemorySource framer(buffer, length);
+	const size_t max_in_flight = std::max<size_t>(pool.size(), 1) * 2;
+	bool truncated = 0;
+	while (1){
+		if (!truncated && framer.available() && queue.size() < max_in_flight){
+			auto begin = framer.get(),
+				end = begin;
+			size_t count = 0;
+			while (count < batch_size && framer.available()){
+				// A record that takes no bytes would never reach the end.
+				if (!T::skip(framer) || framer.get() == end){
+					truncated = 1;
+					break;
+				}
+				end = framer.get();
+				count++;
+			}
+			if (count)
+				queue.submit(pool, std::unique_ptr<ParallelBatch<T> >(new ParallelBatch<T>(begin, end, count)));
+			continue;
+		}
+		if (!queue.size())
+			break;
+		auto batch = queue.pop();
+		for (auto &record : batch->records)
+			callback(std::move(record));
+#ifdef BIN_USE_EXCEPTIONS
+		if (batch->error)
+			std::rethrow_exception(batch->error);
+#endif
+		if (batch->status != ParserStatus::SUCCESS)
+			return batch->status;
+	}
+	if (truncated)
+		BIN_HURL_ERROR(ParserStatus::UNEXPECTED_EOF);
+	return ParserStatus::SUCCESS;
 }
+
+/*
+Parsers generated with --instrument open a probe around every field and
+every whole record. They read integers one at a time rather than in runs,
+so that every field has counters of its own. Unless BIN_INSTRUMENT is
+defined, probes expand to nothing.
+A probe adds to the counters of its site, once the read succeeds: the number
+of reads, the bytes they consumed and the time stamp counter ticks they took.
+Every thread counts into counters of its own, so probes never contend with
+each other. collect_probes() adds up the counters of every thread, including
+those that have exited, grouped by type and field.
+*/
+#ifdef BIN_INSTRUMENT
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BIN_HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BIN_HAS_RDTSC
+#else
+#include <chrono>
+#endif
+
+inline uint64_t read_ticks(){
+#ifdef BIN_HAS_RDTSC
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline uint64_t probe_position(MemorySource &stream){
+	return stream.tell();
+}
+
+inline uint64_t probe_position(std::istream &stream){
+	auto ret = stream.tellg();
+	return ret < 0 ? 0 : (uint64_t)ret;
+}
+
+// Only the owning thread writes its counters, so relaxed loads and stores
+// are enough for the report to read them while they are updated.
+struct ProbeCounters{
+	std::atomic<uint64_t> reads,
+		bytes,
+		ticks;
+	ProbeCounters(): reads(0), bytes(0), ticks(0){}
+	void add(uint64_t bytes, uint64_t ticks){
+		this->reads.store(this->reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		this->bytes.store(this->bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+		this->ticks.store(this->ticks.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+	}
+	void add_from(const ProbeCounters &other){
+		this->reads.store(this->reads.load(std::memory_order_relaxed) + other.reads.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		this->bytes.store(this->bytes.load(std::memory_order_relaxed) + other.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		this->ticks.store(this->ticks.load(std::memory_order_relaxed) + other.ticks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+};
+
+// A site is a place in a parser that a probe measures. field is null for
+// the whole record.
+class ProbeSite{
+	size_t id;
+public:
+	const char *type,
+		*field;
+	ProbeSite(const char *type, const char *field);
+	ProbeCounters &counters() const;
+};
+
+class Probe{
+	const ProbeSite &site;
+	uint64_t position,
+		ticks;
+public:
+	template <typename Source>
+	Probe(const ProbeSite &site, Source &stream): site(site), position(probe_position(stream)), ticks(read_ticks()){}
+	template <typename Source>
+	void finish(Source &stream){
+		auto ticks = read_ticks() - this->ticks;
+		this->site.counters().add(probe_position(stream) - this->position, ticks);
+	}
+};
+
+struct ProbeTotal{
+	std::string type,
+		field;
+	uint64_t reads,
+		bytes,
+		ticks;
+	ProbeTotal(): reads(0), bytes(0), ticks(0){}
+};
+
+std::vector<ProbeTotal> collect_probes();
+// Writes the totals as a table, sorted by ticks, whole records first.
+void write_probe_report(std::ostream &);
+
+#define BIN_PROBE(name, type, field, stream) \
+	static const ProbeSite name##_site(type, field); \
+	Probe name(name##_site, stream)
+#define BIN_PROBE_END(name, stream) name.finish(stream)
+#else
+#define BIN_PROBE(name, type, field, stream)
+#define BIN_PROBE_END(name, stream)
+#endif
@@ -26,17 +26,89 @@ the following restrictions:
 */
 #include "stdafx.h"
 #include "parser.h"
+#include "library.h"
+#include "interpreter.h"
 
 #define PROGRAM_NAME "placeholder"
 
+// Indexes the records of type in the file at path through the type's
+// bytecode, and writes the index to <path>.index.
+static int build_index(const Parser &parser, const char *type, const char *path, const char *interval){
+	std::vector<BytecodeProgram> programs;
+	if (parser.compile_bytecode(programs) != Parser::MetaParserStatus::SUCCESS){
+		std::cerr <<"The specification can't be interpreted.\n";
+		return -1;
+	}
+	auto program = std::find_if(programs.begin(), programs.end(), [type](const BytecodeProgram &p){ return p.get_name() == type; });
+	if (program == programs.end()){
+		std::cerr <<"The specification has no type "<<type<<".\n";
+		return -1;
+	}
+	int k = atoi(interval);
+	if (k <= 0){
+		std::cerr <<"The interval must be a positive number.\n";
+		return -1;
+	}
+	MappedFileSource source(path);
+	if (!source.is_open()){
+		std::cerr <<"Can't open "<<path<<".\n";
+		return -1;
+	}
+	RecordIndex index(k);
+	GenericRecord scratch;
+	if (!index.build(source, [&](MemorySource &s){ return program->skip(scratch, s); })){
+		std::cerr <<path<<" ends in the middle of record "<<index.size()<<".\n";
+		return -1;
+	}
+	std::ofstream file((std::string(path) + ".index").c_str(), std::ios::binary);
+	if (!index.save(file)){
+		std::cerr <<"Can't write "<<path<<".index.\n";
+		return -1;
+	}
+	std::cout <<index.size()<<" records indexed.\n";
+	return 0;
+}
+
 int main(int argc, char **argv){
-	if (argc < 2){
-		std::cerr <<"Usage: Xabin <specification file>\n";
+	// --nothrow generates parsers that report errors by status instead of
+	// throwing. They must be built without BIN_USE_EXCEPTIONS.
+	// --instrument adds probes to the parsers, which count reads, bytes and
+	// time per field when built with BIN_INSTRUMENT.
+	// --cache loads the spec from <specification file>.cache while the
+	// spec hasn't changed, and writes it otherwise.
+	// --index <type> <data file> <K> indexes every K-th record of the type
+	// in the data file (see RecordIndex) instead of generating code.
+	bool use_exceptions = 1,
+		instrument = 0,
+		cache = 0,
+		index = 0;
+	for (; argc > 1 && !strncmp(argv[1], "--", 2); argc--, argv++){
+		if (!strcmp(argv[1], "--nothrow"))
+			use_exceptions = 0;
+		else if (!strcmp(argv[1], "--instrument"))
+			instrument = 1;
+		else if (!strcmp(argv[1], "--cache"))
+			cache = 1;
+		else if (!strcmp(argv[1], "--index"))
+			index = 1;
+		else
+			argc = 0;
+	}
+	if (argc < (index ? 5 : 2)){
+		std::cerr <<
+			"Usage: Xabin [--nothrow] [--instrument] [--cache] <specification file>\n"
+			"       Xabin [--cache] --index <specification file> <type> <data file> <K>\n";
 		return -1;
 	}
 	Parser parser;
-	parser.load_xml(argv[1]);
-	std::cout <<parser.generate_declarations(1);
-	std::cout <<parser.generate_definitions(1);
+	auto status = cache ? parser.load_cached(argv[1], (std::string(argv[1]) + ".cache").c_str()) : parser.load_xml(argv[1]);
+	if (status != Parser::MetaParserStatus::SUCCESS){
+		std::cerr <<"Can't load "<<argv[1]<<" (error "<<(int)status<<").\n";
+		return -1;
+	}
+	if (index)
+		return build_index(parser, argv[2], argv[3], argv[4]);
+	std::cout <<parser.generate_declarations(use_exceptions);
+	std::cout <<parser.generate_definitions(use_exceptions, instrument);
 	return 0;
 }
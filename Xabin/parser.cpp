@@ -47,124 +47,1259 @@ struct DefinedInteger_ptr_cmp{
 	}
 };
 
+static struct{
+	const char *name;
+	// Borrowed data can only be read from contiguous sources.
+	bool contiguous;
+} source_types[] = {
+	{"std::istream", 0},
+	{"MemorySource", 1},
+};
+
+bool DefinedType::is_borrowed() const{
+	for (auto &d : this->data)
+		if (d->is_borrowed())
+			return 1;
+	return 0;
+}
+
+bool DefinedType::uses_allocator() const{
+	for (auto &d : this->data)
+		if (d->uses_allocator())
+			return 1;
+	return 0;
+}
+
+// Generates the member initializers of the data that use the allocator,
+// applying format to each name.
+std::string DefinedType::generate_allocator_initializers(const char *format) const{
+	std::string ret;
+	for (auto &d : this->data){
+		if (!d->uses_allocator())
+			continue;
+		if (ret.size())
+			ret.append(", ");
+		ret << boost::format(format) % d->get_name();
+	}
+	return ret;
+}
+
+/*
+A type has the host's layout if it's made only of integers that decode to
+their own bits, which is the case for unsigned integers and two's
+complement ones, and if all of its multibyte integers have the same
+endianness. The packed struct with the fields in wire order is then an
+exact image of the encoded record on a host of that endianness, which
+condition selects. condition is null if the type has no multibyte fields.
+Requirements are checked over the copied records by Wire::valid().
+*/
+bool DefinedType::has_host_layout(const char *&condition) const{
+	condition = nullptr;
+	if (!this->data.size())
+		return 0;
+	for (auto &d : this->data){
+		if (d->get_type() != DataType::INTEGER)
+			return 0;
+		auto integer = (DefinedInteger *)d.get();
+		if (integer->get_signedness() && integer->get_negative_mapping() != NegativeMapping::TWOSCOMP)
+			return 0;
+		if (integer->get_size() == 1)
+			continue;
+		auto c = integer->get_endianness() == Endianness::BIG ? "BIN_HOST_IS_BIG_ENDIAN" : "!BIN_HOST_IS_BIG_ENDIAN";
+		if (condition && strcmp(condition, c))
+			return 0;
+		condition = c;
+	}
+	return 1;
+}
+
+// Integer members are grouped by type, from the largest to the smallest, so
+// that the struct is packed without padding.
+std::string DefinedType::generate_members(const char *indent, const char *member_type, bool good_flag) const{
+	std::string ret;
+	std::vector<DefinedInteger *> integers;
+	std::vector<DefinedDatum *> nonintegers;
+	for (auto &member : this->data){
+		if (member->get_type() == DataType::INTEGER)
+			integers.push_back((DefinedInteger *)member.get());
+		else
+			nonintegers.push_back(member.get());
+	}
+	std::sort(integers.begin(), integers.end(), DefinedInteger_ptr_cmp());
+	unsigned last_type_id = 0;
+	for (auto p : integers){
+		auto type_id = p->get_int_type_id();
+		if (type_id != last_type_id){
+			if (last_type_id)
+				ret.append(";\n");
+			ret.append(indent);
+			ret << boost::format(member_type) % p->get_c_type();
+			ret.push_back(' ');
+		}else{
+			ret.append(",\n");
+			ret.append(indent);
+			ret.append("\t");
+		}
+		ret.append(p->get_name());
+		last_type_id = type_id;
+	}
+	if (integers.size())
+		ret.append(";\n");
+	if (good_flag){
+		ret.append(indent);
+		ret.append("bool good;\n");
+	}
+	for (auto p : nonintegers){
+		ret.append(indent);
+		ret << boost::format(member_type) % p->get_member_type();
+		ret.push_back(' ');
+		ret.append(p->get_name());
+		ret.append(";\n");
+	}
+	return ret;
+}
+
+/*
+Types with data that use an allocator (see the pmr attribute) are
+allocator-aware: every constructor takes an optional allocator, which the
+data get their memory from, so that containers such as std::pmr::vector pass
+theirs down to the records.
+*/
 std::string DefinedType::generate_declaration(bool use_exceptions) const{
 	std::string ret;
 	boost::format namespace_open("namespace %1%{\n"),
 		namespace_close("} // namespace %1%\n"),
 		struct_open("struct %1%{\n"),
-		constructor_and_close(
-			"\t%1%(std::istream &);\n"
-			"} // struct %1%\n"
+		default_constructor(use_exceptions ? "\t%1%(){}\n" : "\t%1%(): good(0){}\n"),
+		constructor("\t%1%(%2% &%3%);\n"),
+		// In nothrow mode, parse() reports every failure through its result,
+		// running out of memory included.
+		parse(use_exceptions ?
+			"\ttemplate <typename Source>\n"
+			"\tstatic %1% parse(Source &%2%);\n"
+		:
+			"\ttemplate <typename Source>\n"
+			"\tstatic ParseResult<%1%> parse(Source &%2%) noexcept;\n"
+		),
+		// parse_into() reads over an existing record, reusing the memory of
+		// its strings and arrays. reset() empties a record the same way.
+		parse_into(use_exceptions ?
+			"\ttemplate <typename Source>\n"
+			"\tstatic void parse_into(%1% &, Source &);\n"
+			"\tvoid reset();\n"
+		:
+			"\ttemplate <typename Source>\n"
+			"\tstatic ParserStatus parse_into(%1% &, Source &) noexcept;\n"
+			"\tvoid reset();\n"
+		),
+		allocator_members(
+			"\ttypedef std::pmr::polymorphic_allocator<char> allocator_type;\n"
+			"\texplicit %1%(const allocator_type &allocator = allocator_type()): %2%{}\n"
+			"\t%1%(const %1% &, const allocator_type &);\n"
+			"\t%1%(%1% &&, const allocator_type &);\n"
+			"\tallocator_type get_allocator() const{\n"
+			"\t\treturn this->%3%.get_allocator();\n"
+			"\t}\n"
+		),
+		push(
+			"\tParserStatus push(MemorySource &, PushState &);\n"
+			"#ifdef BIN_HAS_COROUTINES\n"
+			"\ttemplate <typename AsyncSource>\n"
+			"\tParseTask parse_async(AsyncSource &);\n"
+			"#endif\n"
+		),
+		// Returns false if the source ends before the record does.
+		skip(
+			"\ttemplate <typename Source>\n"
+			"\tstatic bool skip(Source &);\n"
+			"\t// Checks a record's requirements without building it.\n"
+			"\ttemplate <typename Source>\n"
+			"\tstatic ParserStatus validate(Source &);\n"
+		),
+		serializer(
+			"\tsize_t encoded_size() const;\n"
+			"\tuint8_t *serialize(uint8_t *) const;\n"
+		),
+		// Wire is the record exactly as it's laid out on the wire, so arrays
+		// of records can be copied with read_records() or used in place with
+		// map_records().
+		wire_open(
+			"#pragma pack(push, 1)\n"
+			"\tstruct Wire{\n"
+		),
+		wire_valid_open(
+			"\t\t// Whether the record meets the requirements of the type.\n"
+			"\t\tbool valid() const{\n"
+		),
+		wire_requirement(
+			"\t\t\tif (%1%)\n"
+			"\t\t\t\treturn 0;\n"
+		),
+		wire_close(
+			"\t\t\treturn 1;\n"
+			"\t\t}\n"
+			"\t};\n"
+			"#pragma pack(pop)\n"
+			"\tstatic_assert(sizeof(Wire) == %2%, \"Wire doesn't match the encoded layout.\");\n"
+			"\t%1%(const Wire &);\n"
+		),
+		// Columns holds a sequence of records with one vector per datum.
+		columns_open("\tstruct Columns{\n"),
+		columns_close(
+			"\t\tsize_t record_count() const;\n"
+			"\t\tvoid clear_records();\n"
+			"\t\ttemplate <typename Source>\n"
+			"\t\t%1% append_records(Source &, size_t count);\n"
+			"\t};\n"
+		),
+		close(
+			"private:\n"
+			"\ttemplate <typename Source>\n"
+			"\t%2% read(Source &);\n"
+			"}; // struct %1%\n"
 		);
 	for (auto &ns : this->namespaces)
 		ret << namespace_open % ns;
+	auto allocator = this->uses_allocator();
+	auto allocator_parameter = allocator ? ", const allocator_type & = allocator_type()" : "";
+	if (allocator)
+		ret.append(
+			"#ifndef BIN_HAS_PMR\n"
+			"#error Types with pmr data require std::pmr.\n"
+			"#endif\n"
+		);
 	ret << struct_open % this->name;
-	{
-		std::vector<DefinedInteger *> integers;
-		std::vector<DefinedDatum *> nonintegers;
-		for (auto &member : this->data){
-			if (member->get_type() == DataType::INTEGER)
-				integers.push_back((DefinedInteger *)member.get());
-			else
-				nonintegers.push_back(member.get());
-		}
-		std::sort(integers.begin(), integers.end(), DefinedInteger_ptr_cmp());
-		unsigned last_type_id = 0;
-		for (auto p : integers){
-			auto type_id = p->get_int_type_id();
-			if (type_id != last_type_id){
-				ret.append(last_type_id ? ";\n\t" : "\t");
-				ret.append(p->get_c_type());
-				ret.push_back(' ');
-			}else
-				ret.append(",\n\t\t");
-			ret.append(p->get_name());
-			last_type_id = type_id;
+	ret.append(this->generate_members("\t", "%1%", !use_exceptions));
+	if (allocator){
+		auto initializers = this->generate_allocator_initializers("%1%(allocator)");
+		if (!use_exceptions)
+			initializers = "good(0), " + initializers;
+		auto first = std::find_if(this->data.begin(), this->data.end(), [](const boost::shared_ptr<DefinedDatum> &d){ return d->uses_allocator(); });
+		ret << allocator_members % this->name % initializers % (*first)->get_name();
+	}else
+		ret << default_constructor % this->name;
+	auto borrowed = this->is_borrowed();
+	for (auto &source : source_types)
+		if (source.contiguous || !borrowed)
+			ret << constructor % this->name % source.name % allocator_parameter;
+	ret << parse % this->name % allocator_parameter;
+	ret << parse_into % this->name;
+	ret << skip;
+	ret.append(this->generate_size_bounds());
+	// Borrowed data can't outlive the chunk it was pushed in.
+	if (!borrowed)
+		ret << push;
+	ret << serializer;
+	const char *condition;
+	if (this->has_host_layout(condition)){
+		if (condition)
+			ret << boost::format("#if %1%\n") % condition;
+		ret << wire_open;
+		for (auto &d : this->data)
+			ret << boost::format("\t\t%1%;\n") % d->get_signature();
+		ret << wire_valid_open;
+		for (auto &d : this->data){
+			auto failure = d->generate_requirement_failure("this->" + d->get_name());
+			if (failure.size())
+				ret << wire_requirement % failure;
 		}
-		ret.append(";\n");
+		ret << wire_close % this->name % this->generate_run_size(0, this->data.size());
+		if (condition)
+			ret.append("#endif\n");
+	}
+	ret << columns_open;
+	ret.append(this->generate_members("\t\t", "std::vector<%1%>", 0));
+	ret << columns_close % (use_exceptions ? "void" : "ParserStatus");
+	ret << close % this->name % (use_exceptions ? "void" : "ParserStatus");
+	for (auto &ns : this->namespaces)
+		ret << namespace_close % ns;
+	return ret;
+}
+
+/*
+With instrument set, read() opens a probe (see BIN_PROBE in library.h) around
+the whole record, and around every datum. Integers are then read one at a
+time instead of in runs, so that each field is measured on its own.
+*/
+std::string DefinedType::generate_definition(bool use_exceptions, bool instrument) const{
+	boost::format namespace_open("namespace %1%{\n"),
+		namespace_close("} // namespace %1%\n"),
+		read_open(
+			"template <typename Source>\n"
+			"%1% %2%::read(Source &stream){\n"
+		),
+		constructor(use_exceptions ?
+			"%1%::%1%(%2% &stream%3%)%4%{\n"
+			"\tthis->read(stream);\n"
+			"}\n"
+		:
+			"%1%::%1%(%2% &stream%3%)%4%{\n"
+			"\tthis->good = this->read(stream) == ParserStatus::SUCCESS;\n"
+			"}\n"
+		),
+		parse(use_exceptions ?
+			"template <typename Source>\n"
+			"%1% %1%::parse(Source &stream%2%){\n"
+			"\t%1% ret%3%;\n"
+			"\tret.read(stream);\n"
+			"\treturn ret;\n"
+			"}\n"
+		:
+			"template <typename Source>\n"
+			"ParseResult<%1%> %1%::parse(Source &stream%2%) noexcept{\n"
+			"\tParseResult<%1%> ret%3%;\n"
+			"\tret.status = guard_allocation([&](){ return ret.value.read(stream); });\n"
+			"\tret.value.good = ret.status == ParserStatus::SUCCESS;\n"
+			"\treturn ret;\n"
+			"}\n"
+		),
+		parse_into(use_exceptions ?
+			"template <typename Source>\n"
+			"void %1%::parse_into(%1% &dst, Source &stream){\n"
+			"\tdst.read(stream);\n"
+			"}\n"
+		:
+			"template <typename Source>\n"
+			"ParserStatus %1%::parse_into(%1% &dst, Source &stream) noexcept{\n"
+			"\tauto ret = guard_allocation([&](){ return dst.read(stream); });\n"
+			"\tdst.good = ret == ParserStatus::SUCCESS;\n"
+			"\treturn ret;\n"
+			"}\n"
+		),
+		// The integers are copied in the body, which leaves the initializers
+		// in declaration order.
+		allocator_copy(
+			"%1%::%1%(const %1% &other, const allocator_type &allocator): %2%{\n"
+			"%4%"
+			"}\n"
+			"%1%::%1%(%1% &&other, const allocator_type &allocator): %3%{\n"
+			"%4%"
+			"}\n"
+		);
+	boost::format probe("\tBIN_PROBE(%1%, \"%2%\", %3%, stream);\n"),
+		probe_end("\tBIN_PROBE_END(%1%, stream);\n");
+	std::string ret,
+		qualified_name;
+	for (auto &ns : this->namespaces){
+		ret << namespace_open % ns;
+		qualified_name.append(ns);
+		qualified_name.append("::");
+	}
+	qualified_name.append(this->name);
+	ret << read_open % (use_exceptions ? "void" : "ParserStatus") % this->name;
+	if (!use_exceptions)
+		ret.append("\tParserStatus status;\n");
+	if (instrument)
+		ret << probe % "record_probe" % qualified_name % "nullptr";
+	for (size_t i = 0; i < this->data.size();){
+		auto run = instrument ? i + 1 : std::max(this->find_integer_run(i), i + 1);
+		auto probe_name = (boost::format("probe%1%") % i).str();
+		if (instrument)
+			ret << probe % probe_name % qualified_name % ("\"" + this->data[i]->get_name() + "\"");
+		if (run - i < 2)
+			ret.append(this->generate_read_step(i, use_exceptions));
+		else
+			ret.append(this->generate_integer_run(i, run, use_exceptions));
+		if (instrument)
+			ret << probe_end % probe_name;
+		i = run;
+	}
+	if (instrument)
+		ret << probe_end % "record_probe";
+	if (!use_exceptions)
+		ret.append("\treturn ParserStatus::SUCCESS;\n");
+	ret.append("}\n");
+	auto allocator = this->uses_allocator();
+	std::string initializers;
+	if (allocator)
+		initializers = ": " + this->generate_allocator_initializers("%1%(allocator)");
+	auto allocator_parameter = allocator ? ", const allocator_type &allocator" : "";
+	auto borrowed = this->is_borrowed();
+	for (auto &source : source_types)
+		if (source.contiguous || !borrowed)
+			ret << constructor % this->name % source.name % allocator_parameter % initializers;
+	ret << parse % this->name % allocator_parameter % (allocator ? "(allocator)" : "");
+	ret << parse_into % this->name;
+	ret << boost::format("void %1%::reset(){\n") % this->name;
+	for (auto &d : this->data){
+		ret.push_back('\t');
+		ret.append(d->generate_reset_code());
+		ret.push_back('\n');
+	}
+	if (!use_exceptions)
+		ret.append("\tthis->good = 0;\n");
+	ret.append("}\n");
+	if (allocator){
+		std::string copies;
+		for (auto &d : this->data)
+			if (!d->uses_allocator())
+				copies << boost::format("\tthis->%1% = other.%1%;\n") % d->get_name();
 		if (!use_exceptions)
-			ret.append("\tbool good;\n");
-		for (auto p : nonintegers){
-			ret.append("\t");
-			ret.append(p->get_signature());
-			ret.append(";\n");
+			copies.append("\tthis->good = other.good;\n");
+		ret << allocator_copy
+			% this->name
+			% this->generate_allocator_initializers("%1%(other.%1%, allocator)")
+			% this->generate_allocator_initializers("%1%(std::move(other.%1%), allocator)")
+			% copies;
+	}
+	ret.append(this->generate_columns_definition(use_exceptions));
+	for (auto &ns : this->namespaces)
+		ret << namespace_close % ns;
+	return ret;
+}
+
+std::string DefinedType::generate_read_step(size_t index, bool use_exceptions) const{
+	auto &d = this->data[index];
+	std::string ret;
+	// Owned strings and arrays are read in place, so that reading over an
+	// existing record reuses its memory.
+	auto assign = d->generate_assign_code();
+	if (assign.size()){
+		ret << boost::format(
+			"\tif (BIN_UNLIKELY(!%1%))\n"
+			"\t\t%2%;\n"
+		) % assign % (use_exceptions ? "throw_parsing_exception(ParserStatus::UNEXPECTED_EOF)" : "return ParserStatus::UNEXPECTED_EOF");
+	}else if (!use_exceptions){
+		ret.append("\tstatus = ");
+		ret.append(d->generate_read_code(use_exceptions));
+		ret.append(
+			";\n"
+			"\tif (BIN_UNLIKELY(status != ParserStatus::SUCCESS))\n"
+			"\t\treturn status;\n"
+		);
+	}else{
+		ret.push_back('\t');
+		ret.append(d->generate_read_code(use_exceptions));
+		ret.append(";\n");
+	}
+	ret.append(d->generate_requirement_code(use_exceptions));
+	return ret;
+}
+
+// Returns the end of the run of consecutive integers that starts at index.
+size_t DefinedType::find_integer_run(size_t index) const{
+	while (index < this->data.size() && this->data[index]->get_type() == DataType::INTEGER)
+		index++;
+	return index;
+}
+
+/*
+A run of consecutive integers is read with a single bounds check for the
+whole run, after which every field is decoded straight from the run.
+take_run() only fails near the end of the input, and it doesn't consume
+anything when it does, so the slow path reads the same fields one at a time
+and reports errors exactly as if there were no fast path.
+*/
+std::string DefinedType::generate_integer_run(size_t first, size_t last, bool use_exceptions) const{
+	unsigned size = 0;
+	std::string fast,
+		slow;
+	for (auto i = first; i < last; i++){
+		auto integer = (DefinedInteger *)this->data[i].get();
+		fast << boost::format("\tthis->%1% = %2%;\n") % integer->get_name() % integer->generate_decode_code(size ? (boost::format("run + %1%") % size).str() : "run");
+		fast.append(integer->generate_requirement_code(use_exceptions));
+		slow.append(this->generate_read_step(i, use_exceptions));
+		size += integer->get_size();
+	}
+	boost::replace_all(fast, "\n\t", "\n\t\t\t");
+	boost::replace_all(slow, "\n\t", "\n\t\t\t");
+	std::string ret;
+	ret << boost::format(
+		"\t{\n"
+		"\t\tuint8_t buffer[%1%];\n"
+		"\t\tif (auto run = take_run(stream, buffer, %1%)){\n"
+		"\t\t%2%"
+		"\t\t}else{\n"
+		"\t\t%3%"
+		"\t\t}\n"
+		"\t}\n"
+	) % size % fast % slow;
+	return ret;
+}
+
+// The members of Columns, which no column may be named after.
+static const char *const columns_members[] = {
+	"record_count",
+	"clear_records",
+	"append_records",
+};
+
+/*
+Columns::append_records() reads each record into a scratch instance and
+moves its data to the end of the columns, so that a record is only appended
+once it has been read in full and the columns always have the same length.
+Records made only of integers are decoded straight into the columns instead,
+after their requirements are checked, and only go through a scratch instance
+when take_run() can't have the whole record at once.
+*/
+std::string DefinedType::generate_columns_definition(bool use_exceptions) const{
+	boost::format size(
+			"size_t %1%::Columns::record_count() const{\n"
+			"\treturn %2%;\n"
+			"}\n"
+		),
+		append_open(
+			"template <typename Source>\n"
+			"%2% %1%::Columns::append_records(Source &stream, size_t count){\n"
+		),
+		reserve("\tthis->%1%.reserve(this->%1%.size() + count);\n"),
+		move("\t\tthis->%1%.push_back(std::move(record.%1%));\n"),
+		decode("\t\t\tthis->%1%.push_back(%2%);\n"),
+		requirement(
+			"\t\t\tif (BIN_UNLIKELY(%1%))\n"
+			"\t\t\t\t%2%;\n"
+		);
+	const char *read_record = use_exceptions ?
+		"\t\trecord.read(stream);\n"
+	:
+		"\t\tauto status = record.read(stream);\n"
+		"\t\tif (BIN_UNLIKELY(status != ParserStatus::SUCCESS))\n"
+		"\t\t\treturn status;\n";
+	std::string ret;
+	ret << size % this->name % (this->data.size() ? "this->" + this->data.front()->get_name() + ".size()" : "0");
+	ret << boost::format("void %1%::Columns::clear_records(){\n") % this->name;
+	for (auto &d : this->data)
+		ret << boost::format("\tthis->%1%.clear();\n") % d->get_name();
+	ret.append("}\n");
+	ret << append_open % this->name % (use_exceptions ? "void" : "ParserStatus");
+	for (auto &d : this->data)
+		ret << reserve % d->get_name();
+	std::string moves;
+	for (auto &d : this->data)
+		moves << move % d->get_name();
+	if (this->data.size() && this->find_integer_run(0) == this->data.size()){
+		std::string checks,
+			decodes;
+		unsigned offset = 0;
+		for (auto &d : this->data){
+			auto integer = (DefinedInteger *)d.get();
+			auto value = integer->generate_decode_code(offset ? (boost::format("run + %1%") % offset).str() : "run");
+			auto failure = integer->generate_requirement_failure(value);
+			if (failure.size())
+				checks << requirement % failure % (use_exceptions ? "throw_parsing_exception(ParserStatus::REQUIREMENT_NOT_MET)" : "return ParserStatus::REQUIREMENT_NOT_MET");
+			decodes << decode % integer->get_name() % value;
+			offset += integer->get_size();
 		}
+		std::string slow = read_record;
+		slow.append(moves);
+		boost::replace_all(slow, "\n\t", "\n\t\t");
+		ret << boost::format(
+			"\tfor (size_t i = 0; i < count; i++){\n"
+			"\t\tuint8_t buffer[%1%];\n"
+			"\t\tif (auto run = take_run(stream, buffer, %1%)){\n"
+			"%2%"
+			"%3%"
+			"\t\t}else{\n"
+			"\t\t\t%4% record;\n"
+			"\t%5%"
+			"\t\t}\n"
+			"\t}\n"
+		) % offset % checks % decodes % this->name % slow;
+	}else{
+		ret << boost::format("\t%1% record;\n") % this->name;
+		ret.append("\tfor (size_t i = 0; i < count; i++){\n");
+		ret.append(read_record);
+		ret.append(moves);
+		ret.append("\t}\n");
 	}
-	ret <<constructor_and_close % this->name;
+	if (!use_exceptions)
+		ret.append("\treturn ParserStatus::SUCCESS;\n");
+	ret.append("}\n");
+	return ret;
+}
+
+/*
+skip() advances a source past a record, decoding nothing but the lengths
+that later data depend on. validate() also decodes the integers that have
+requirements, and checks them. Runs of data whose sizes are known without
+scanning them, and that aren't decoded, are skipped with a single bump.
+*/
+std::string DefinedType::generate_walk(bool validate) const{
+	auto failure = validate ? "return ParserStatus::UNEXPECTED_EOF" : "return false";
+	boost::format skip_run(
+		"\tif (BIN_UNLIKELY(!skip_bytes(stream, %1%)))\n"
+		"\t\t%2%;\n"
+	);
+	std::string ret;
+	auto captured = this->collect_dependencies(0, this->data.size());
+	if (validate)
+		for (auto &d : this->data)
+			if (d->has_requirement())
+				captured.push_back(d->get_name());
+	size_t run = 0;
+	for (size_t i = 0; i < this->data.size(); i++){
+		auto &d = this->data[i];
+		if (d->is_sized() && std::find(captured.begin(), captured.end(), d->get_name()) == captured.end())
+			continue;
+		if (run < i)
+			ret << skip_run % this->generate_run_size(run, i) % failure;
+		ret.append(this->generate_skip_step(i, captured, failure));
+		if (validate && d->get_type() == DataType::INTEGER)
+			ret.append(d->generate_requirement_code(0, d->get_name()));
+		run = i + 1;
+	}
+	if (run < this->data.size())
+		ret << skip_run % this->generate_run_size(run, this->data.size()) % failure;
+	return ret;
+}
+
+std::string DefinedType::generate_skip_definition() const{
+	boost::format namespace_open("namespace %1%{\n"),
+		namespace_close("} // namespace %1%\n");
+	std::string ret;
+	for (auto &ns : this->namespaces)
+		ret << namespace_open % ns;
+	ret << boost::format(
+		"template <typename Source>\n"
+		"bool %1%::skip(Source &stream){\n"
+	) % this->name;
+	ret.append(this->generate_walk(0));
+	ret.append(
+		"\treturn true;\n"
+		"}\n"
+	);
 	for (auto &ns : this->namespaces)
 		ret << namespace_close % ns;
 	return ret;
 }
 
-std::string DefinedType::generate_definition(bool use_exceptions) const{
+std::string DefinedType::generate_validate_definition() const{
 	boost::format namespace_open("namespace %1%{\n"),
 		namespace_close("} // namespace %1%\n");
 	std::string ret;
 	for (auto &ns : this->namespaces)
 		ret << namespace_open % ns;
-	ret.append(this->name);
-	ret.append("::");
-	ret.append(this->name);
-	ret.append("(std::istream &stream): good(false){\n");
+	ret << boost::format(
+		"template <typename Source>\n"
+		"ParserStatus %1%::validate(Source &stream){\n"
+	) % this->name;
+	ret.append(this->generate_walk(1));
+	ret.append(
+		"\treturn ParserStatus::SUCCESS;\n"
+		"}\n"
+	);
+	for (auto &ns : this->namespaces)
+		ret << namespace_close % ns;
+	return ret;
+}
+
+std::string DefinedType::generate_wire_definition(bool use_exceptions) const{
+	const char *condition;
+	if (!this->has_host_layout(condition))
+		return std::string();
+	boost::format namespace_open("namespace %1%{\n"),
+		namespace_close("} // namespace %1%\n");
+	std::string ret;
+	if (condition)
+		ret << boost::format("#if %1%\n") % condition;
+	for (auto &ns : this->namespaces)
+		ret << namespace_open % ns;
+	ret << boost::format("%1%::%1%(const Wire &wire){\n") % this->name;
+	for (auto &d : this->data)
+		ret << boost::format("\tthis->%1% = wire.%1%;\n") % d->get_name();
 	if (!use_exceptions)
-		ret.append("\tParserStatus status;\n");
+		ret.append("\tthis->good = 1;\n");
+	ret.append("}\n");
+	for (auto &ns : this->namespaces)
+		ret << namespace_close % ns;
+	if (condition)
+		ret.append("#endif\n");
+	return ret;
+}
+
+/*
+The push parser is a switch over the index of the datum being read, with
+every case falling through to the next, so that a call can resume in the
+middle of the record.
+*/
+std::string DefinedType::generate_push_definition(bool use_exceptions) const{
+	if (this->is_borrowed())
+		return std::string();
+	boost::format namespace_open("namespace %1%{\n"),
+		namespace_close("} // namespace %1%\n"),
+		push_open(
+			"ParserStatus %1%::push(MemorySource &chunk, PushState &state){\n"
+			"\tswitch (state.field){\n"
+		),
+		push_case(
+			"\t\tcase %1%:\n"
+			"\t\t\tif (!%2%)\n"
+			"\t\t\t\treturn ParserStatus::INCOMPLETE;\n"
+		),
+		// The state is left at the start of the record, so that the next
+		// push() doesn't resume in the middle of the one that failed.
+		push_requirement(
+			"\t\t\tif (BIN_UNLIKELY(%1%)){\n"
+			"\t\t\t\tstate.reset();\n"
+			"\t\t\t\t%2%;\n"
+			"\t\t\t}\n"
+		),
+		// The coroutine flavor drives push() and waits on the source whenever
+		// the data it has buffered runs out.
+		async_definition(
+			"#ifdef BIN_HAS_COROUTINES\n"
+			"template <typename AsyncSource>\n"
+			"ParseTask %1%::parse_async(AsyncSource &source){\n"
+			"\tPushState state;\n"
+			"\twhile (1){\n"
+			"\t\tauto status = this->push(source, state);\n"
+			"\t\tif (status != ParserStatus::INCOMPLETE)\n"
+			"\t\t\tco_return status;\n"
+			"\t\tif (!co_await source.fill())\n"
+			"\t\t\tco_return ParserStatus::UNEXPECTED_EOF;\n"
+			"\t}\n"
+			"}\n"
+			"#endif\n"
+		);
+	std::string ret;
+	for (auto &ns : this->namespaces)
+		ret << namespace_open % ns;
+	ret << push_open % this->name;
+	for (size_t i = 0; i < this->data.size(); i++){
+		auto &d = this->data[i];
+		ret << push_case % i % d->generate_push_code();
+		auto failure = d->generate_requirement_failure("this->" + d->get_name());
+		if (failure.size()){
+			ret << push_requirement
+				% failure
+				% (use_exceptions ? "throw_parsing_exception(ParserStatus::REQUIREMENT_NOT_MET)" : "return ParserStatus::REQUIREMENT_NOT_MET");
+		}
+		ret.append("\t\t\tstate.next();\n");
+		if (i + 1 < this->data.size())
+			ret.append("\t\t\tBIN_FALLTHROUGH;\n");
+	}
+	ret.append(
+		"\t}\n"
+		"\tstate.reset();\n"
+		"\treturn ParserStatus::SUCCESS;\n"
+		"}\n"
+	);
+	ret << async_definition % this->name;
+	for (auto &ns : this->namespaces)
+		ret << namespace_close % ns;
+	return ret;
+}
+
+std::string DefinedType::generate_serializer_definition() const{
+	boost::format namespace_open("namespace %1%{\n"),
+		namespace_close("} // namespace %1%\n"),
+		size_open("size_t %1%::encoded_size() const{\n"),
+		serialize_open("uint8_t *%1%::serialize(uint8_t *dst) const{\n");
+	std::string ret;
+	for (auto &ns : this->namespaces)
+		ret << namespace_open % ns;
+	ret << size_open % this->name;
+	unsigned constant = 0;
+	std::string variable;
 	for (auto d : this->data){
-		if (!use_exceptions){
-			ret.append("\tstatus = ");
-			ret.append(d->generate_read_code(use_exceptions));
-			ret.append(
-				";\n"
-				"\tif (status != ParserStatus::SUCCESS)\n"
-				"\t\treturn status;\n"
-			);
-		}else{
-			ret.push_back('\t');
-			ret.append(d->generate_read_code(use_exceptions));
-			ret.append(";\n");
+		if (d->get_type() == DataType::INTEGER){
+			constant += ((DefinedInteger *)d.get())->get_size();
+			continue;
 		}
-		ret.append(d->generate_requirement_code(use_exceptions));
+		variable.append(" + ");
+		variable.append(d->generate_size_code());
 	}
+	ret << boost::format("\treturn %1%%2%;\n") % constant % variable;
 	ret.append("}\n");
+	ret << serialize_open % this->name;
+	for (auto d : this->data){
+		ret.append("\tdst = ");
+		ret.append(d->generate_write_code());
+		ret.append(";\n");
+	}
+	ret.append(
+		"\treturn dst;\n"
+		"}\n"
+	);
 	for (auto &ns : this->namespaces)
 		ret << namespace_close % ns;
 	return ret;
 }
 
-std::string DefinedInteger::generate_read_code(bool use_exceptions) const{
-	const char *with_exceptions    = "this->%1% = read_%2%_integer<%3%, %4%, correct_sign_%5%>(stream)";
-	const char *without_exceptions = "read_%2%_integer_nothrow<%3%, %4%, correct_sign_%5%>(this->%1%, stream)";
-	boost::format format(use_exceptions ? with_exceptions : without_exceptions);
+const DefinedDatum *DefinedType::find_datum(const std::string &name) const{
+	for (auto &d : this->data)
+		if (d->get_name() == name)
+			return d.get();
+	return nullptr;
+}
+
+// Returns the number of leading data whose offsets within the record don't
+// depend on its contents; that is, up to and including the first datum of
+// variable size.
+size_t DefinedType::count_static_offsets() const{
+	for (size_t i = 0; i < this->data.size(); i++)
+		if (!this->data[i]->is_fixed_size())
+			return i + 1;
+	return this->data.size();
+}
+
+// Generates the combined size of data [first, last), all of which must be
+// sized. Outside of a walk over the record, they must have a fixed size.
+std::string DefinedType::generate_run_size(size_t first, size_t last) const{
+	unsigned constant = 0;
+	std::string variable;
+	for (size_t i = first; i < last; i++){
+		auto &d = this->data[i];
+		if (d->get_type() == DataType::INTEGER){
+			constant += ((DefinedInteger *)d.get())->get_size();
+			continue;
+		}
+		variable.append(" + ");
+		variable.append(d->generate_size_code());
+	}
+	if (!constant && variable.size())
+		return variable.substr(3);
+	return (boost::format("%1%%2%") % constant % variable).str();
+}
+
+/*
+The encoded size of a record is bounded below by its integers, its fixed
+strings and arrays, and the terminators of its C-style ones. It's bounded
+above only if every length is either fixed or read from an unsigned
+integer of at most 32 bits.
+*/
+std::string DefinedType::generate_size_bounds() const{
+	unsigned min_constant = 0;
+	std::string min_variable,
+		max_variable;
+	bool bounded = 1;
+	for (auto &d : this->data){
+		if (d->get_type() == DataType::INTEGER){
+			min_constant += ((DefinedInteger *)d.get())->get_size();
+			continue;
+		}
+		if (d->is_fixed_size()){
+			min_variable.append(" + ");
+			min_variable.append(d->generate_size_code());
+			continue;
+		}
+		auto dependency = d->get_length()->get_dependency();
+		if (!dependency){
+			min_constant += d->get_element_size();
+			bounded = 0;
+			continue;
+		}
+		auto length = this->find_datum(*dependency);
+		if (!length || length->get_type() != DataType::INTEGER || !strcmp(d->get_length()->get_length_word(), "user_length")){
+			bounded = 0;
+			continue;
+		}
+		auto integer = (const DefinedInteger *)length;
+		if (integer->get_signedness() || integer->get_size() > 4){
+			bounded = 0;
+			continue;
+		}
+		max_variable << boost::format(" + (uint64_t)0x%1$X * %2%") % ((1ULL << integer->get_size() * 8) - 1) % d->get_element_size();
+	}
+	std::string ret;
+	ret << boost::format("\tstatic constexpr uint64_t min_encoded_size = %1%%2%;\n") % min_constant % min_variable;
+	if (bounded)
+		ret << boost::format("\tstatic constexpr uint64_t max_encoded_size = %1%%2%%3%;\n") % min_constant % min_variable % max_variable;
+	return ret;
+}
+
+// Returns the names of the data that the lengths of data [first, last) are
+// read from.
+std::vector<std::string> DefinedType::collect_dependencies(size_t first, size_t last) const{
+	std::vector<std::string> ret;
+	for (auto i = first; i < last; i++){
+		auto length = this->data[i]->get_length();
+		auto dependency = length ? length->get_dependency() : nullptr;
+		if (dependency)
+			ret.push_back(*dependency);
+	}
+	return ret;
+}
+
+// Generates code that advances stream past a datum, decoding it into a local
+// of the same name if it's one of the dependencies.
+std::string DefinedType::generate_skip_step(size_t index, const std::vector<std::string> &dependencies, const char *failure) const{
+	auto &d = this->data[index];
+	boost::format check(
+		"\tif (BIN_UNLIKELY(!%1%))\n"
+		"\t\t%2%;\n"
+	);
+	std::string ret;
+	if (d->get_type() != DataType::INTEGER || std::find(dependencies.begin(), dependencies.end(), d->get_name()) == dependencies.end()){
+		ret << check % d->generate_skip_code() % failure;
+		return ret;
+	}
+	ret << boost::format("\t%1% %2%;\n") % d->get_member_type() % d->get_name();
+	ret << check % ((DefinedInteger *)d.get())->generate_capture_code(d->get_name()) % failure;
+	return ret;
+}
+
+// Declares a local named after a datum, holding its value as returned by the
+// view's accessor.
+std::string DefinedType::generate_view_fetch(const std::string &name, bool use_exceptions) const{
+	auto datum = this->find_datum(name);
+	auto type = datum ? datum->get_value_type() : std::string("size_t");
+	boost::format with_exceptions("\t%1% %2% = this->get_%2%();\n"),
+		without_exceptions(
+			"\t%1% %2%;\n"
+			"\tstatus = this->get_%2%(%2%);\n"
+			"\tif (BIN_UNLIKELY(status != ParserStatus::SUCCESS))\n"
+			"\t\treturn status;\n"
+		);
+	return ((use_exceptions ? with_exceptions : without_exceptions) % type % name).str();
+}
+
+std::string DefinedType::generate_view_declaration(bool use_exceptions) const{
+	boost::format namespace_open("namespace %1%{\n"),
+		namespace_close("} // namespace %1%\n"),
+		class_open("class %1%View : public RecordView{\n"),
+		locator(
+			"\tmutable size_t offsets[%1%];\n"
+			"\tmutable bool located;\n"
+			"\t%2% locate() const;\n"
+		),
+		constructor(
+			"public:\n"
+			"\t%1%View(const void *data, size_t size): RecordView(data, size)%2%{}\n"
+		),
+		accessor(use_exceptions ?
+			"\t%1% get_%2%() const;\n"
+		:
+			"\tParserStatus get_%2%(%1% &) const;\n"
+		);
+	std::string ret;
+	for (auto &ns : this->namespaces)
+		ret << namespace_open % ns;
+	ret << class_open % this->name;
+	auto static_offsets = this->count_static_offsets();
+	bool lazy = static_offsets < this->data.size();
+	if (lazy)
+		ret << locator % (this->data.size() - static_offsets) % (use_exceptions ? "void" : "ParserStatus");
+	ret << constructor % this->name % (lazy ? ", located(0)" : "");
+	for (auto &d : this->data)
+		ret << accessor % d->get_value_type() % d->get_name();
+	ret << boost::format("}; // class %1%View\n") % this->name;
+	for (auto &ns : this->namespaces)
+		ret << namespace_close % ns;
+	return ret;
+}
+
+/*
+locate() walks the record from the first datum of variable size, recording
+where each of the following data starts. Lengths read from earlier data are
+decoded along the way, or through their accessors if they come before the
+walk starts.
+*/
+std::string DefinedType::generate_view_definition(bool use_exceptions) const{
+	boost::format namespace_open("namespace %1%{\n"),
+		namespace_close("} // namespace %1%\n"),
+		accessor_open(use_exceptions ?
+			"%1% %3%View::get_%2%() const{\n"
+		:
+			"ParserStatus %3%View::get_%2%(%1% &dst) const{\n"
+		),
+		ensure_located(use_exceptions ?
+			"\tif (!this->located)\n"
+			"\t\tthis->locate();\n"
+		:
+			"\tif (!this->located){\n"
+			"\t\tstatus = this->locate();\n"
+			"\t\tif (BIN_UNLIKELY(status != ParserStatus::SUCCESS))\n"
+			"\t\t\treturn status;\n"
+			"\t}\n"
+		),
+		accessor_close(
+			"\tauto stream = this->at(%1%);\n"
+			"\treturn %2%;\n"
+			"}\n"
+		);
+	auto failure = use_exceptions ? "throw_parsing_exception(ParserStatus::UNEXPECTED_EOF)" : "return ParserStatus::UNEXPECTED_EOF";
+	std::string ret;
+	for (auto &ns : this->namespaces)
+		ret << namespace_open % ns;
+	auto static_offsets = this->count_static_offsets();
+	for (size_t i = 0; i < this->data.size(); i++){
+		auto &d = this->data[i];
+		ret << accessor_open % d->get_value_type() % d->get_name() % this->name;
+		auto dependency = d->get_length() ? d->get_length()->get_dependency() : nullptr;
+		bool lazy = i >= static_offsets;
+		if (!use_exceptions && (lazy || dependency))
+			ret.append("\tParserStatus status;\n");
+		if (lazy)
+			ret << ensure_located;
+		if (dependency)
+			ret.append(this->generate_view_fetch(*dependency, use_exceptions));
+		std::string offset;
+		if (lazy)
+			offset = (boost::format("this->offsets[%1%]") % (i - static_offsets)).str();
+		else
+			offset = this->generate_run_size(0, i);
+		ret << accessor_close % offset % d->generate_read_call(use_exceptions, "dst");
+	}
+	if (static_offsets < this->data.size()){
+		auto first = static_offsets - 1;
+		ret << boost::format("%1% %2%View::locate() const{\n") % (use_exceptions ? "void" : "ParserStatus") % this->name;
+		// Lengths needed by the walk are either fetched before it or decoded
+		// during it.
+		auto dependencies = this->collect_dependencies(first, this->data.size() - 1);
+		std::string fetches;
+		for (size_t i = 0; i < first; i++)
+			if (std::find(dependencies.begin(), dependencies.end(), this->data[i]->get_name()) != dependencies.end())
+				fetches.append(this->generate_view_fetch(this->data[i]->get_name(), use_exceptions));
+		if (!use_exceptions && fetches.size())
+			ret.append("\tParserStatus status;\n");
+		ret.append(fetches);
+		ret << boost::format("\tauto stream = this->at(%1%);\n") % this->generate_run_size(0, first);
+		for (auto i = first; i < this->data.size(); i++){
+			if (i > first)
+				ret << boost::format("\tthis->offsets[%1%] = (size_t)stream.tell();\n") % (i - static_offsets);
+			if (i < this->data.size() - 1)
+				ret.append(this->generate_skip_step(i, dependencies, failure));
+		}
+		ret.append("\tthis->located = 1;\n");
+		if (!use_exceptions)
+			ret.append("\treturn ParserStatus::SUCCESS;\n");
+		ret.append("}\n");
+	}
+	for (auto &ns : this->namespaces)
+		ret << namespace_close % ns;
+	return ret;
+}
+
+std::string DefinedInteger::generate_skip_code() const{
+	return (boost::format("skip_bytes(stream, %1%)") % this->size).str();
+}
+
+std::string DefinedInteger::generate_decode_code(const std::string &src) const{
+	boost::format format("decode_integer<%2%, %3%, %4%, correct_sign_%5%>(%1%)");
+	return (format
+		% src
+		% this->get_c_type()
+		% this->size
+		% (this->format.endianness == Endianness::BIG ? "true" : "false")
+		% this->get_negative_mapping_word()).str();
+}
+
+std::string DefinedInteger::generate_capture_code(const std::string &dst) const{
+	boost::format format("skip_%2%_integer<%3%, %4%, correct_sign_%5%>(stream, %1%)");
+	return (format
+		% dst
+		% this->get_endianness_word()
+		% this->get_c_type()
+		% this->size
+		% this->get_negative_mapping_word()).str();
+}
+
+std::string DefinedString::generate_skip_code() const{
+	if (!this->is_sized())
+		return "skip_cstyle_string(stream)";
+	return "skip_bytes(stream, " + this->generate_size_code() + ")";
+}
+
+std::string DefinedArray::generate_skip_code() const{
+	if (this->is_sized())
+		return "skip_bytes(stream, " + this->generate_size_code() + ")";
+	if (this->borrowed)
+		return "skip_cstyle_string(stream)";
+	boost::format format("skip_%1%_cstyle_array<%2%, %3%, correct_sign_%4%>(stream)");
+	return (format
+		% this->type->get_endianness_word()
+		% this->type->get_c_type()
+		% this->type->get_size()
+		% this->type->get_negative_mapping_word()).str();
+}
+
+std::string DefinedInteger::generate_size_code() const{
+	return (boost::format("%1%") % this->size).str();
+}
+
+std::string DefinedInteger::generate_write_code() const{
+	boost::format format("write_%2%_integer<%3%, %4%, correct_sign_%5%>(dst, this->%1%)");
+	return (format
+		% this->name
+		% this->get_endianness_word()
+		% this->get_c_type()
+		% this->size
+		% this->get_negative_mapping_word()).str();
+}
+
+std::string DefinedString::generate_size_code() const{
+	return this->length->generate_count("this->" + this->name);
+}
+
+std::string DefinedString::generate_write_code() const{
+	boost::format format("write_%2%_string(dst, this->%1%%3%)");
+	return (format
+		% this->name
+		% this->length->get_length_word()
+		% this->length->generate_length_parameter()).str();
+}
+
+std::string DefinedArray::generate_size_code() const{
+	auto count = this->length->generate_count("this->" + this->name);
+	if (this->type->get_size() == 1)
+		return count;
+	return (boost::format("%1% * %2%") % count % this->type->get_size()).str();
+}
+
+std::string DefinedArray::generate_write_code() const{
+	if (this->borrowed){
+		boost::format format("write_%2%_string(dst, this->%1%%3%)");
+		return (format
+			% this->name
+			% this->length->get_length_word()
+			% this->length->generate_length_parameter()).str();
+	}
+	boost::format format("write_%2%_%3%_array<%4%, %5%, correct_sign_%6%>(dst, this->%1%%7%)");
+	return (format
+		% this->name
+		% this->type->get_endianness_word()
+		% this->length->get_length_word()
+		% this->type->get_c_type()
+		% this->type->get_size()
+		% this->type->get_negative_mapping_word()
+		% this->length->generate_length_parameter()).str();
+}
+
+std::string DefinedInteger::generate_push_code() const{
+	boost::format format("push_%2%_integer<%3%, %4%, correct_sign_%5%>(this->%1%, chunk, state)");
+	return (format
+		% this->name
+		% this->get_endianness_word()
+		% this->get_c_type()
+		% this->size
+		% this->get_negative_mapping_word()).str();
+}
+
+std::string DefinedString::generate_push_code() const{
+	boost::format format("push_%2%_string(this->%1%, chunk, state%3%)");
+	return (format
+		% this->name
+		% this->length->get_length_word()
+		% this->length->generate_length_parameter()).str();
+}
+
+std::string DefinedArray::generate_push_code() const{
+	boost::format format("push_%2%_%3%_array<%4%, %5%, correct_sign_%6%>(this->%1%, chunk, state%7%)");
 	return (format
 		% this->name
+		% this->type->get_endianness_word()
+		% this->length->get_length_word()
+		% this->type->get_c_type()
+		% this->type->get_size()
+		% this->type->get_negative_mapping_word()
+		% this->length->generate_length_parameter()).str();
+}
+
+std::string DefinedInteger::generate_read_call(bool use_exceptions, const std::string &dst) const{
+	const char *with_exceptions    = "read_%2%_integer<%3%, %4%, correct_sign_%5%>(stream)";
+	const char *without_exceptions = "read_%2%_integer_nothrow<%3%, %4%, correct_sign_%5%>(%1%, stream)";
+	boost::format format(use_exceptions ? with_exceptions : without_exceptions);
+	return (format
+		% dst
 		% this->get_endianness_word()
 		% this->get_c_type()
 		% this->size
 		% this->get_negative_mapping_word()).str();
 }
 
-std::string RequireCapableDatum::generate_requirement_code(bool use_exceptions) const{
+std::string RequireCapableDatum::generate_requirement_code(bool use_exceptions, const std::string &value) const{
 	if (!this->req.get())
 		return std::string();
 	const char *with_exceptions =
-		"\tif (!(this->%1% %2%))\n"
-		"\t\tthrow ParsingException(ParserStatus::REQUIREMENT_NOT_MET);\n";
+		"\tif (BIN_UNLIKELY(%1%))\n"
+		"\t\tthrow_parsing_exception(ParserStatus::REQUIREMENT_NOT_MET);\n";
 	const char *without_exceptions =
-		"\tif (!(this->%1% %2%))\n"
+		"\tif (BIN_UNLIKELY(%1%))\n"
 		"\t\treturn ParserStatus::REQUIREMENT_NOT_MET;\n";
 	boost::format format(use_exceptions ? with_exceptions : without_exceptions);
-	return (format % this->name % this->req->generate_code()).str();
+	return (format % this->generate_requirement_failure(value)).str();
 }
 
-std::string DefinedString::generate_read_code(bool use_exceptions) const{
-	const char *with_exceptions    = "this->%1% = read_%2%_string(stream%3%)";
-	const char *without_exceptions = "read_%2%_string_nothrow(this->%1%, stream%3%)";
+std::string RequireCapableDatum::generate_requirement_failure(const std::string &value) const{
+	if (!this->req.get())
+		return std::string();
+	return (boost::format("!(%1% %2%)") % value % this->req->generate_code()).str();
+}
+
+std::string DefinedString::generate_read_call(bool use_exceptions, const std::string &dst) const{
+	const char *with_exceptions    = "read_%2%_string%4%(stream%3%)";
+	const char *without_exceptions = "read_%2%_string%4%_nothrow(%1%, stream%3%)";
 	boost::format format(use_exceptions ? with_exceptions : without_exceptions);
+	return (format
+		% dst
+		% this->length->get_length_word()
+		% this->length->generate_length_parameter()
+		% (this->borrowed ? "_view" : "")).str();
+}
+
+std::string DefinedString::generate_assign_code() const{
+	if (this->borrowed)
+		return std::string();
+	boost::format format("assign_%2%_string(this->%1%, stream%3%)");
 	return (format
 		% this->name
 		% this->length->get_length_word()
 		% this->length->generate_length_parameter()).str();
 }
 
+std::string DefinedString::generate_reset_code() const{
+	if (this->borrowed)
+		return DefinedDatum::generate_reset_code();
+	return "this->" + this->name + ".clear();";
+}
+
+std::string DefinedArray::get_member_type() const{
+	if (this->uses_allocator())
+		return (boost::format("std::pmr::vector<%1%>") % this->type->get_c_type()).str();
+	return this->get_value_type();
+}
+
+std::string DefinedArray::get_value_type() const{
+	if (this->borrowed)
+		return "ByteView";
+	return (boost::format("std::vector<%1%>") % this->type->get_c_type()).str();
+}
+
+std::string DefinedArray::generate_assign_code() const{
+	if (this->borrowed)
+		return std::string();
+	auto terminated = !strcmp(this->length->get_length_word(), "cstyle");
+	boost::format format("read_%2%integer_array<%3%, %4%, %5%, correct_sign_%6%>(this->%1%, stream%7%)");
+	return (format
+		% this->name
+		% (terminated ? "terminated_" : "")
+		% this->type->get_c_type()
+		% this->type->get_size()
+		% (this->type->get_endianness() == Endianness::BIG ? "true" : "false")
+		% this->type->get_negative_mapping_word()
+		% this->length->generate_length_parameter()).str();
+}
+
+std::string DefinedArray::generate_reset_code() const{
+	if (this->borrowed)
+		return DefinedDatum::generate_reset_code();
+	return "this->" + this->name + ".clear();";
+}
+
+std::string DefinedArray::generate_read_call(bool use_exceptions, const std::string &dst) const{
+	if (this->borrowed){
+		const char *with_exceptions    = "read_%2%_byte_view(stream%3%)";
+		const char *without_exceptions = "read_%2%_byte_view_nothrow(%1%, stream%3%)";
+		boost::format format(use_exceptions ? with_exceptions : without_exceptions);
+		return (format
+			% dst
+			% this->length->get_length_word()
+			% this->length->generate_length_parameter()).str();
+	}
+	const char *with_exceptions    = "read_%2%_%3%_array<%4%, %5%, correct_sign_%6%>(stream%7%)";
+	const char *without_exceptions = "read_%2%_%3%_array_nothrow<%4%, %5%, correct_sign_%6%>(%1%, stream%7%)";
+	boost::format format(use_exceptions ? with_exceptions : without_exceptions);
+	return (format
+		% dst
+		% this->type->get_endianness_word()
+		% this->length->get_length_word()
+		% this->type->get_c_type()
+		% this->type->get_size()
+		% this->type->get_negative_mapping_word()
+		% this->length->generate_length_parameter()).str();
+}
+
 //-----------------------------------------------------------------------------
 
 static struct{
@@ -187,34 +1322,78 @@ DefinedInteger::DefinedInteger(tinyxml2::XMLElement *integer, const IntegerForma
 	this->signedness = type.signedness;
 	this->size = type.bitness / 8;
 	for (auto el = integer->FirstChildElement(); el; el = el->NextSiblingElement()){
-		if (!strcmp(integer->Name(), "require")){
+		if (!strcmp(el->Name(), "require")){
 			this->req.reset(new Requirement(el));
 		}
 	}
 }
 
-DefinedString::DefinedString(tinyxml2::XMLElement *string): RequireCapableDatum(DataType::STRING){
-	this->name = guaranteed_get_attribute(string, "name");
-	auto length = string->Attribute("length");
-	if (!length){
-		this->length.reset(new CStyleArrayLength);
-		return;
-	}
+DefinedInteger::DefinedInteger(const std::string &name, const IntegerFormat &format, const IntegerType &type): RequireCapableDatum(DataType::INTEGER){
+	this->name = name;
+	this->format = format;
+	this->signedness = type.signedness;
+	this->size = type.bitness / 8;
+}
+
+ArrayLength *parse_length(tinyxml2::XMLElement *el){
+	auto length = el->Attribute("length");
+	if (!length)
+		return new CStyleArrayLength;
 	std::string stdlength = length;
 	if (!stdlength.size())
 		throw Parser::MetaParserStatus::MALFORMED_XML_STRUCTURE;
 	switch (stdlength[0]){
 		case '$':
-			this->length.reset(new PrestatedArrayLength(stdlength.substr(1)));
-			break;
+			return new PrestatedArrayLength(stdlength.substr(1));
 		case '@':
-			this->length.reset(new UserArrayLength(stdlength.substr(1)));
-			break;
+			return new UserArrayLength(stdlength.substr(1));
 		default:
-			this->length.reset(new FixedArrayLength(stdlength));
+			return new FixedArrayLength(stdlength);
 	}
 }
 
+DefinedString::DefinedString(const std::string &name, const boost::shared_ptr<ArrayLength> &length, bool borrow, bool pmr): RequireCapableDatum(DataType::STRING){
+	this->name = name;
+	this->length = length;
+	this->borrowed = borrow;
+	this->pmr = pmr;
+}
+
+DefinedString::DefinedString(tinyxml2::XMLElement *string, bool borrow, bool pmr): RequireCapableDatum(DataType::STRING){
+	this->name = guaranteed_get_attribute(string, "name");
+	this->length.reset(parse_length(string));
+	this->borrowed = borrow;
+	string->QueryBoolAttribute("borrow", &this->borrowed);
+	this->pmr = pmr;
+	string->QueryBoolAttribute("pmr", &this->pmr);
+}
+
+IntegerType *find(const char *id);
+
+DefinedArray::DefinedArray(tinyxml2::XMLElement *array, const IntegerFormat &format, bool borrow, bool pmr): DefinedDatum(DataType::ARRAY){
+	this->name = guaranteed_get_attribute(array, "name");
+	auto type = find(guaranteed_get_attribute(array, "type").c_str());
+	if (!type)
+		throw Parser::MetaParserStatus::MALFORMED_XML_STRUCTURE;
+	this->type.reset(new DefinedInteger(this->name, format, *type));
+	this->length.reset(parse_length(array));
+	// Only byte arrays are laid out the same on the wire and in memory.
+	bool byte_array = !type->signedness && type->bitness == 8;
+	this->borrowed = borrow && byte_array;
+	if (array->QueryBoolAttribute("borrow", &this->borrowed) == tinyxml2::XML_SUCCESS && this->borrowed && !byte_array)
+		throw Parser::MetaParserStatus::MALFORMED_XML_STRUCTURE;
+	this->pmr = pmr;
+	array->QueryBoolAttribute("pmr", &this->pmr);
+}
+
+DefinedArray::DefinedArray(const std::string &name, const IntegerFormat &format, const IntegerType &type, const boost::shared_ptr<ArrayLength> &length, bool borrow, bool pmr): DefinedDatum(DataType::ARRAY){
+	this->name = name;
+	this->type.reset(new DefinedInteger(name, format, type));
+	this->length = length;
+	this->borrowed = borrow;
+	this->pmr = pmr;
+}
+
 IntegerType *find(const char *id){
 	for (auto &p : type_pairs)
 		if (!strcmp(p.name, id))
@@ -229,7 +1408,9 @@ void DefinedType::parse(tinyxml2::XMLElement *type, ParserState &state){
 		if (i)
 			this->add_datum(boost::shared_ptr<DefinedDatum>(new DefinedInteger(el, state.current_format, *i)));
 		else if (name == "string")
-			this->add_datum(boost::shared_ptr<DefinedDatum>(new DefinedString(el)));
+			this->add_datum(boost::shared_ptr<DefinedDatum>(new DefinedString(el, state.borrow, state.pmr)));
+		else if (name == "array")
+			this->add_datum(boost::shared_ptr<DefinedDatum>(new DefinedArray(el, state.current_format, state.borrow, state.pmr)));
 		else if (name == "format")
 			state.current_format = IntegerFormat(el);
 		else if (name == "scope"){
@@ -242,13 +1423,19 @@ void DefinedType::parse(tinyxml2::XMLElement *type, ParserState &state){
 DefinedType::DefinedType(tinyxml2::XMLElement *type, ParserState &state){
 	this->namespaces = state.current_namespace;
 	this->name = guaranteed_get_attribute(type, "name");
+	type->QueryBoolAttribute("borrow", &state.borrow);
+	type->QueryBoolAttribute("pmr", &state.pmr);
 	std::map<std::string, IntegerType> map;
 	for (auto &pair : type_pairs)
 		map[pair.name] = pair.type;
 	parse(type, state);
+	for (auto &d : this->data)
+		for (auto member : columns_members)
+			if (d->get_name() == member)
+				throw Parser::MetaParserStatus::INVALID_IDENTIFIER;
 }
 
-Requirement::Requirement(tinyxml2::XMLElement *req){
+Requirement::Requirement(tinyxml2::XMLElement *req): rel(Relation::NONE){
 	for (auto attr = req->FirstAttribute(); attr; attr = attr->Next()){
 		std::string name = attr->Name();
 		Relation rel = Relation::NONE;
@@ -276,7 +1463,7 @@ IntegerFormat::IntegerFormat(){
 	this->negative_mapping = NegativeMapping::TWOSCOMP;
 }
 
-IntegerFormat::IntegerFormat(tinyxml2::XMLElement *el){
+IntegerFormat::IntegerFormat(tinyxml2::XMLElement *el): IntegerFormat(){
 	for (auto attr = el->FirstAttribute(); attr; attr = attr->Next()){
 		std::string name = attr->Name();
 		if (name == "end"){
@@ -350,8 +1537,12 @@ Parser::MetaParserStatus Parser::load_xml(const char *file_path){
 				return MetaParserStatus::UNKNOWN_XML_ERROR;
 		}
 	}
+	return this->load_xml(doc);
+}
+
+Parser::MetaParserStatus Parser::load_xml(tinyxml2::XMLDocument &doc){
 	auto spec = doc.FirstChildElement();
-	if (strcmp(spec->Name(), "spec"))
+	if (!spec || strcmp(spec->Name(), "spec"))
 		return MetaParserStatus::MALFORMED_XML_STRUCTURE;
 
 	try{
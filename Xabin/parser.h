@@ -79,7 +79,15 @@ private:
 	std::string value;
 public:
 	Requirement(tinyxml2::XMLElement *);
+	Requirement(Relation rel, const std::string &value): rel(rel), value(value){}
 	virtual ~Requirement(){}
+	Relation get_relation() const{
+		return this->rel;
+	}
+	// The value as written in the spec, which is a C++ expression.
+	const std::string &get_value() const{
+		return this->value;
+	}
 	const char *generate_relational() const{
 		switch (this->rel){
 			case Relation::NONE:
@@ -124,7 +132,17 @@ class ArrayLength{
 public:
 	virtual ~ArrayLength(){}
 	virtual const char *get_length_word() const = 0;
+	// True if the length is known without reading any data.
+	virtual bool is_fixed() const{
+		return 0;
+	}
+	// Name of the datum the length is read from, if any.
+	virtual const std::string *get_dependency() const{
+		return nullptr;
+	}
 	virtual std::string generate_length_parameter() const = 0;
+	// Number of elements on the wire, including any terminator.
+	virtual std::string generate_count(const std::string &member) const = 0;
 };
 
 class FixedArrayLength : public ArrayLength{
@@ -134,11 +152,17 @@ public:
 	const char *get_length_word() const{
 		return "sized";
 	}
+	bool is_fixed() const{
+		return 1;
+	}
 	std::string generate_length_parameter() const{
 		std::string ret(", ");
 		ret.append(this->length);
 		return ret;
 	}
+	std::string generate_count(const std::string &) const{
+		return "(size_t)(" + this->length + ")";
+	}
 };
 
 class CStyleArrayLength: public ArrayLength{
@@ -149,6 +173,9 @@ public:
 	std::string generate_length_parameter() const{
 		return std::string();
 	}
+	std::string generate_count(const std::string &member) const{
+		return "(" + member + ".size() + 1)";
+	}
 };
 
 class NamedArrayLength : public ArrayLength{
@@ -157,6 +184,12 @@ public:
 	NamedArrayLength(const std::string &name): name(name){}
 	std::string name;
 	virtual ~NamedArrayLength(){}
+	const std::string *get_dependency() const{
+		return &this->name;
+	}
+	std::string generate_count(const std::string &) const{
+		return "(size_t)" + this->name;
+	}
 };
 
 class PrestatedArrayLength : public NamedArrayLength{
@@ -200,14 +233,90 @@ public:
 	}
 	virtual void set_length(ArrayLength *){}
 	virtual void set_length(boost::shared_ptr<ArrayLength> &){}
-	virtual std::string get_signature() const = 0;
+	virtual const ArrayLength *get_length() const{
+		return nullptr;
+	}
+	// True if the datum always takes the same number of bytes on the wire.
+	virtual bool is_fixed_size() const{
+		return 1;
+	}
+	// True if the size of the datum follows from the data before it, so it
+	// can be skipped without scanning it.
+	virtual bool is_sized() const{
+		return 1;
+	}
+	// Size of each element of a string or array.
+	virtual unsigned get_element_size() const{
+		return 0;
+	}
+	virtual std::string get_member_type() const = 0;
+	// The type of the datum outside of a record, as returned by views.
+	virtual std::string get_value_type() const{
+		return this->get_member_type();
+	}
+	std::string get_signature() const{
+		return this->get_member_type() + " " + this->name;
+	}
+	// True if the datum points into the source's buffer instead of owning
+	// a copy of its data.
+	virtual bool is_borrowed() const{
+		return 0;
+	}
+	// True if the member takes its memory from the record's allocator.
+	virtual bool uses_allocator() const{
+		return 0;
+	}
 	const std::string &get_name() const{
 		return this->name;
 	}
-	virtual std::string generate_requirement_code(bool use_exceptions) const{
+	virtual bool has_requirement() const{
+		return 0;
+	}
+	virtual const Requirement *get_requirement() const{
+		return nullptr;
+	}
+	std::string generate_requirement_code(bool use_exceptions) const{
+		return this->generate_requirement_code(use_exceptions, "this->" + this->name);
+	}
+	// Generates a check of the requirement against the value of an
+	// expression.
+	virtual std::string generate_requirement_code(bool, const std::string &) const{
 		return std::string();
 	}
-	virtual std::string generate_read_code(bool use_exceptions) const = 0;
+	// Generates an expression that is true if the value of an expression
+	// doesn't meet the requirement. Empty if there's no requirement.
+	virtual std::string generate_requirement_failure(const std::string &) const{
+		return std::string();
+	}
+	// Generates a statement that reads the datum from stream into dst.
+	std::string generate_read_code(bool use_exceptions, const std::string &dst) const{
+		auto call = this->generate_read_call(use_exceptions, dst);
+		return use_exceptions ? dst + " = " + call : call;
+	}
+	std::string generate_read_code(bool use_exceptions) const{
+		return this->generate_read_code(use_exceptions, "this->" + this->name);
+	}
+	// Generates the call to the reader. Only the nothrow reader takes dst.
+	virtual std::string generate_read_call(bool use_exceptions, const std::string &dst) const = 0;
+	// Generates a call that reads the datum into its member in place,
+	// keeping the member's capacity and allocator, and returns false if the
+	// input runs out. Empty for data that are simply assigned.
+	virtual std::string generate_assign_code() const{
+		return std::string();
+	}
+	// Generates a statement that empties the member, keeping its capacity.
+	virtual std::string generate_reset_code() const{
+		return "this->" + this->name + " = " + this->get_member_type() + "();";
+	}
+	// Generates a call that advances a MemorySource past the datum and
+	// returns false if the input runs out.
+	virtual std::string generate_skip_code() const = 0;
+	// Generates a call that returns false if the chunk runs out.
+	virtual std::string generate_push_code() const = 0;
+	// Generates an expression for the number of bytes the datum takes on the
+	// wire.
+	virtual std::string generate_size_code() const = 0;
+	virtual std::string generate_write_code() const = 0;
 };
 
 class RequireCapableDatum : public DefinedDatum{
@@ -216,7 +325,18 @@ protected:
 public:
 	RequireCapableDatum(DataType type): DefinedDatum(type){}
 	virtual ~RequireCapableDatum(){}
-	std::string generate_requirement_code(bool use_exceptions) const;
+	void set_requirement(const boost::shared_ptr<Requirement> &req){
+		this->req = req;
+	}
+	bool has_requirement() const{
+		return !!this->req.get();
+	}
+	const Requirement *get_requirement() const{
+		return this->req.get();
+	}
+	using DefinedDatum::generate_requirement_code;
+	std::string generate_requirement_code(bool use_exceptions, const std::string &value) const;
+	std::string generate_requirement_failure(const std::string &value) const;
 };
 
 struct IntegerType{
@@ -230,6 +350,7 @@ class DefinedInteger : public RequireCapableDatum{
 	unsigned size;
 public:
 	DefinedInteger(tinyxml2::XMLElement *, const IntegerFormat &format, const IntegerType &);
+	DefinedInteger(const std::string &name, const IntegerFormat &format, const IntegerType &);
 	unsigned get_size() const{
 		return this->size;
 	}
@@ -260,6 +381,12 @@ public:
 		}
 		return 0;
 	}
+	Endianness get_endianness() const{
+		return this->format.endianness;
+	}
+	NegativeMapping get_negative_mapping() const{
+		return this->format.negative_mapping;
+	}
 	const char *get_endianness_word() const{
 		switch (this->format.endianness){
 			case Endianness::LITTLE:
@@ -286,44 +413,127 @@ public:
 		}
 		return 0;
 	}
-	std::string get_signature() const{
-		return std::string();
+	std::string get_member_type() const{
+		return this->get_c_type();
 	}
-	std::string generate_read_code(bool use_exceptions) const;
+	std::string generate_read_call(bool use_exceptions, const std::string &dst) const;
+	std::string generate_skip_code() const;
+	// Like generate_skip_code(), but also decodes the integer into dst.
+	std::string generate_capture_code(const std::string &dst) const;
+	// Generates an expression that decodes the integer from a pointer.
+	std::string generate_decode_code(const std::string &src) const;
+	std::string generate_push_code() const;
+	std::string generate_size_code() const;
+	std::string generate_write_code() const;
 };
 
 class DefinedString : public RequireCapableDatum{
 	boost::shared_ptr<ArrayLength> length;
+	bool borrowed,
+		pmr;
 public:
-	DefinedString(tinyxml2::XMLElement *);
+	DefinedString(tinyxml2::XMLElement *, bool borrow, bool pmr);
+	DefinedString(const std::string &name, const boost::shared_ptr<ArrayLength> &, bool borrow, bool pmr);
 	void set_length(ArrayLength *length){
 		this->length.reset(length);
 	}
 	void set_length(boost::shared_ptr<ArrayLength> &length){
 		this->length = length;
 	}
-	std::string get_signature() const{
-		return "std::string " + this->name;
+	const ArrayLength *get_length() const{
+		return this->length.get();
+	}
+	bool is_fixed_size() const{
+		return this->length->is_fixed();
 	}
-	std::string generate_read_code(bool use_exceptions) const;
+	bool is_sized() const{
+		return this->length->is_fixed() || this->length->get_dependency();
+	}
+	std::string get_member_type() const{
+		return this->uses_allocator() ? "std::pmr::string" : this->get_value_type();
+	}
+	std::string get_value_type() const{
+		return this->borrowed ? "std::string_view" : "std::string";
+	}
+	unsigned get_element_size() const{
+		return 1;
+	}
+	bool is_borrowed() const{
+		return this->borrowed;
+	}
+	bool uses_allocator() const{
+		return this->pmr && !this->borrowed;
+	}
+	std::string generate_read_call(bool use_exceptions, const std::string &dst) const;
+	std::string generate_assign_code() const;
+	std::string generate_reset_code() const;
+	std::string generate_skip_code() const;
+	std::string generate_push_code() const;
+	std::string generate_size_code() const;
+	std::string generate_write_code() const;
 };
 
 class DefinedArray : public DefinedDatum{
-	boost::shared_ptr<DefinedDatum> type;
+	boost::shared_ptr<DefinedInteger> type;
 	boost::shared_ptr<ArrayLength> length;
+	bool borrowed,
+		pmr;
 public:
-	DefinedArray(tinyxml2::XMLElement *);
-	std::string get_signature() const;
-	std::string generate_read_code(bool use_exceptions) const;
+	DefinedArray(tinyxml2::XMLElement *, const IntegerFormat &format, bool borrow, bool pmr);
+	DefinedArray(const std::string &name, const IntegerFormat &format, const IntegerType &, const boost::shared_ptr<ArrayLength> &, bool borrow, bool pmr);
+	const DefinedInteger *get_element_type() const{
+		return this->type.get();
+	}
+	std::string get_member_type() const;
+	std::string get_value_type() const;
+	unsigned get_element_size() const{
+		return this->type->get_size();
+	}
+	const ArrayLength *get_length() const{
+		return this->length.get();
+	}
+	bool is_fixed_size() const{
+		return this->length->is_fixed();
+	}
+	bool is_sized() const{
+		return this->length->is_fixed() || this->length->get_dependency();
+	}
+	bool is_borrowed() const{
+		return this->borrowed;
+	}
+	bool uses_allocator() const{
+		return this->pmr && !this->borrowed;
+	}
+	std::string generate_read_call(bool use_exceptions, const std::string &dst) const;
+	std::string generate_assign_code() const;
+	std::string generate_reset_code() const;
+	std::string generate_skip_code() const;
+	std::string generate_push_code() const;
+	std::string generate_size_code() const;
+	std::string generate_write_code() const;
 };
 
 class ParserState;
+class BytecodeProgram;
 
 class DefinedType{
 	std::vector<std::string> namespaces;
 	std::string name;
 	std::vector<boost::shared_ptr<DefinedDatum> > data;
 	void parse(tinyxml2::XMLElement *, ParserState &);
+	std::string generate_members(const char *indent, const char *member_type, bool good_flag) const;
+	const DefinedDatum *find_datum(const std::string &name) const;
+	size_t count_static_offsets() const;
+	std::string generate_run_size(size_t first, size_t last) const;
+	std::string generate_size_bounds() const;
+	std::vector<std::string> collect_dependencies(size_t first, size_t last) const;
+	std::string generate_skip_step(size_t index, const std::vector<std::string> &dependencies, const char *failure) const;
+	std::string generate_walk(bool validate) const;
+	std::string generate_read_step(size_t index, bool use_exceptions) const;
+	size_t find_integer_run(size_t index) const;
+	std::string generate_integer_run(size_t first, size_t last, bool use_exceptions) const;
+	std::string generate_view_fetch(const std::string &name, bool use_exceptions) const;
+	std::string generate_allocator_initializers(const char *format) const;
 public:
 	DefinedType(){}
 	DefinedType(tinyxml2::XMLElement *, ParserState &);
@@ -336,13 +546,36 @@ public:
 	void set_name(const std::string &name){
 		this->name = name;
 	}
+	const std::string &get_name() const{
+		return this->name;
+	}
+	const std::vector<std::string> &get_namespaces() const{
+		return this->namespaces;
+	}
+	const std::vector<boost::shared_ptr<DefinedDatum> > &get_data() const{
+		return this->data;
+	}
+	bool is_borrowed() const;
+	bool uses_allocator() const;
+	bool has_host_layout(const char *&condition) const;
 	std::string generate_declaration(bool use_exceptions) const;
-	std::string generate_definition(bool use_exceptions) const;
+	std::string generate_definition(bool use_exceptions, bool instrument) const;
+	std::string generate_push_definition(bool use_exceptions) const;
+	std::string generate_serializer_definition() const;
+	std::string generate_columns_definition(bool use_exceptions) const;
+	std::string generate_skip_definition() const;
+	std::string generate_validate_definition() const;
+	std::string generate_wire_definition(bool use_exceptions) const;
+	std::string generate_view_declaration(bool use_exceptions) const;
+	std::string generate_view_definition(bool use_exceptions) const;
 };
 
 class ParserState{
 public:
 	IntegerFormat current_format;
+	// Defaults for the borrow and pmr attributes of strings and arrays.
+	bool borrow,
+		pmr;
 	enum class BlockType{
 		NONE,
 		UNSPECIFIC,
@@ -354,7 +587,7 @@ public:
 	boost::shared_ptr<DefinedDatum> current_datum;
 	boost::shared_ptr<Requirement> current_requirement;
 	boost::shared_ptr<ArrayLength> current_length;
-	ParserState(): current_block(BlockType::NONE){}
+	ParserState(): borrow(0), pmr(0), current_block(BlockType::NONE){}
 };
 
 class Parser{
@@ -381,6 +614,7 @@ public:
 		REQUIRE_ONLY_FOR_SIMPLE_VALUES,
 		MALFORMED_XML_STRUCTURE,
 		INVALID_FORMAT_SPECIFIER,
+		STALE_CACHE,
 	};
 private:
 	ParserState state;
@@ -400,23 +634,67 @@ private:
 	MetaParserStatus add_datum_to_type();
 
 	void parse(tinyxml2::XMLElement *, ParserState &);
+	MetaParserStatus load_xml(tinyxml2::XMLDocument &);
 public:
 	MetaParserStatus operator<<(std::istream &stream);
+	const std::vector<boost::shared_ptr<DefinedType> > &get_types() const{
+		return this->types;
+	}
+	// Compiles every type for the interpreter (see interpreter.h).
+	MetaParserStatus compile_bytecode(std::vector<BytecodeProgram> &) const;
 	std::string generate_declarations(bool use_exceptions) const{
-		std::string ret;
+		// The runtime has to be built for the same error mode.
+		std::string ret = use_exceptions ?
+			"#ifndef BIN_USE_EXCEPTIONS\n"
+			"#error These parsers were generated for BIN_USE_EXCEPTIONS.\n"
+			"#endif\n"
+		:
+			"#ifdef BIN_USE_EXCEPTIONS\n"
+			"#error These parsers were generated for nothrow mode.\n"
+			"#endif\n";
 		for (auto &t : this->types){
 			ret.append(t->generate_declaration(use_exceptions));
 			ret.append("\n");
+			ret.append(t->generate_view_declaration(use_exceptions));
+			ret.append("\n");
 		}
 		return ret;
 	}
-	std::string generate_definitions(bool use_exceptions) const{
+	std::string generate_definitions(bool use_exceptions, bool instrument) const{
 		std::string ret;
 		for (auto &t : this->types){
-			ret.append(t->generate_definition(use_exceptions));
+			ret.append(t->generate_definition(use_exceptions, instrument));
+			ret.append("\n");
+			ret.append(t->generate_skip_definition());
+			ret.append("\n");
+			ret.append(t->generate_validate_definition());
+			ret.append("\n");
+			auto wire = t->generate_wire_definition(use_exceptions);
+			if (wire.size()){
+				ret.append(wire);
+				ret.append("\n");
+			}
+			auto push = t->generate_push_definition(use_exceptions);
+			if (push.size()){
+				ret.append(push);
+				ret.append("\n");
+			}
+			ret.append(t->generate_serializer_definition());
+			ret.append("\n");
+			ret.append(t->generate_view_definition(use_exceptions));
 			ret.append("\n");
 		}
 		return ret;
 	}
 	Parser::MetaParserStatus load_xml(const char *file_path);
+	// Loads the spec from the cache at cache_path if it was made from the
+	// current contents of xml_path. Otherwise loads xml_path and writes the
+	// cache for the next time. See cache.cpp.
+	MetaParserStatus load_cached(const char *xml_path, const char *cache_path);
+	// Loads a cache from memory, such as a mapped file. Fails with
+	// STALE_CACHE if it was made from a spec with another hash, or by
+	// another version of Xabin.
+	MetaParserStatus load_cache(const void *data, size_t size, uint64_t content_hash);
+	MetaParserStatus save_cache(const char *path, uint64_t content_hash) const;
+	static uint64_t hash_spec(const void *data, size_t size);
 };
@@ -28,6 +28,7 @@ the following restrictions:
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <cstring>
 #include <map>
 #include <vector>
 #include <cassert>
@@ -35,5 +36,6 @@ the following restrictions:
 #include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/format.hpp>
+#include <boost/algorithm/string/replace.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 #include "tinyxml2.h"